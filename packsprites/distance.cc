@@ -0,0 +1,89 @@
+#include <limits>
+
+#include "distance.h"
+
+namespace {
+
+const float infinity = std::numeric_limits<float>::infinity();
+
+// one-dimensional transform, in place, of n samples of f that are stride
+// apart: f(q) = min(p) (q - p)^2 + f(p). v, z and d are scratch space for
+// n, n + 1 and n elements
+void
+transform_1d(float *f, int n, int stride, int *v, float *z, float *d)
+{
+	// lower envelope of the parabolas rooted at the samples that aren't
+	// infinitely far; parabola v[k] is the lowest one between z[k] and z[k + 1]
+
+	int k = -1;
+
+	for (int q = 0; q < n; q++) {
+		const float fq = f[q*stride];
+
+		if (fq == infinity)
+			continue;
+
+		float s = -infinity;
+
+		while (k >= 0) {
+			const int p = v[k];
+			s = ((fq + q*q) - (f[p*stride] + p*p))/(2*(q - p));
+
+			if (s > z[k])
+				break;
+
+			--k;
+		}
+
+		++k;
+		v[k] = q;
+		z[k] = s;
+	}
+
+	if (k < 0)
+		return; // no samples, all infinitely far
+
+	z[k + 1] = infinity;
+
+	for (int q = 0, j = 0; q < n; q++) {
+		while (z[j + 1] < q)
+			++j;
+
+		const int p = v[j];
+		d[q] = (q - p)*(q - p) + f[p*stride];
+	}
+
+	for (int q = 0; q < n; q++)
+		f[q*stride] = d[q];
+}
+
+} // (anonymous namespace)
+
+image<float>
+squared_distance(const image<float>& im, float threshold)
+{
+	const int width = im.width;
+	const int height = im.height;
+
+	image<float> rv(width, height);
+
+	std::transform(
+		std::begin(im.pixels),
+		std::end(im.pixels),
+		std::begin(rv.pixels),
+		[=](float v) { return v >= threshold ? 0.f : infinity; });
+
+	const int n = std::max(width, height);
+
+	std::vector<int> v(n);
+	std::vector<float> z(n + 1);
+	std::vector<float> d(n);
+
+	for (int c = 0; c < width; c++)
+		transform_1d(&rv(0, c), height, width, &v[0], &z[0], &d[0]);
+
+	for (int r = 0; r < height; r++)
+		transform_1d(&rv(r, 0), width, 1, &v[0], &z[0], &d[0]);
+
+	return rv;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "image.h"
+
+// squared euclidean distance from each pixel to the nearest pixel whose
+// value is at least threshold (infinity if there's none). linear time,
+// after Felzenszwalb & Huttenlocher,
+// "Distance Transforms of Sampled Functions"
+image<float>
+squared_distance(const image<float>& im, float threshold);
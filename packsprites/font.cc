@@ -2,58 +2,84 @@
 #include <cmath>
 #include <array>
 
-#include <tinyxml.h>
-
 #include "rgba.h"
 #include "image.h"
+#include "distance.h"
 #include "panic.h"
+#include "sheet_writer.h"
 #include "font.h"
 
 namespace {
 
-template <typename T>
-image<T>
-dilate(const image<T>& im, int radius)
+// distance fields are computed from glyphs rendered this many times bigger
+const int distance_field_scale = 8;
+
+// antialiased edge of the disc dilate() uses: 1 up to radius, then falling
+// to 0 at radius + 1
+float
+disc_weight(float distance, int radius)
+{
+	return distance <= radius ? 1 : 1 - (distance - radius);
+}
+
+// dilation with a disc of the given radius with an antialiased edge: each
+// pixel gets the max of v*w(d) over the pixels of the image, where v is
+// their value, d their distance and w(d) = disc_weight(d). the pixels with
+// a value of at least v are closer than any with v alone, so it takes a
+// distance transform for each value in the image; with few enough pixels
+// in the disc it's cheaper to look at all of them
+image<float>
+dilate(const image<float>& im, int radius)
 {
-	float kernel[2*radius + 1][2*radius + 1];
+	std::vector<float> values(im.pixels);
+	std::sort(std::begin(values), std::end(values));
+	values.erase(std::unique(std::begin(values), std::end(values)), std::end(values));
+
+	image<float> rv(im.width, im.height);
 
-	for (int i = 0; i < 2*radius + 1; i++) {
-		for (int j = 0; j < 2*radius + 1; j++) {
-			const int dr = i - radius;
-			const int dc = j - radius;
+	const int max_distance = (radius + 1)*(radius + 1);
 
-			const float l = sqrtf(dr*dr + dc*dc);
+	struct offset { int dr, dc; float w; };
+	std::vector<offset> disc;
 
-			if (l <= radius)
-				kernel[i][j] = 1.;
-			else if (l < radius + 1.)
-				kernel[i][j] = 1. - (l - radius);
-			else
-				kernel[i][j] = 0.;
+	for (int dr = -radius; dr <= radius; dr++) {
+		for (int dc = -radius; dc <= radius; dc++) {
+			if (dr*dr + dc*dc < max_distance)
+				disc.push_back({ dr, dc, disc_weight(sqrtf(dr*dr + dc*dc), radius) });
 		}
 	}
 
-	image<T> rv(im.width, im.height);
+	// a distance transform costs about as much as two pixels of the disc
+	if (disc.size() <= 2*values.size()) {
+		const int width = im.width;
+		const int height = im.height;
 
-	auto dest = std::begin(rv.pixels);
+		for (int r = 0; r < height; r++) {
+			for (int c = 0; c < width; c++) {
+				float v = 0;
 
-	for (int i = 0; i < im.height; i++) {
-		for (int j = 0; j < im.width; j++) {
-			float v = 0;
+				for (const auto& o : disc) {
+					const int sr = r + o.dr;
+					const int sc = c + o.dc;
 
-			for (int dr = -radius; dr <= radius; dr++) {
-				for (int dc = -radius; dc <= radius; dc++) {
-					int r = i + dr;
-					int c = j + dc;
-
-					if (r >= 0 && r < im.height && c >= 0 && c < im.width) {
-						const float w = kernel[dr + radius][dc + radius];
-						v = std::max(v, w*im.pixels[r*im.width + c]);
-					}
+					if (sr >= 0 && sr < height && sc >= 0 && sc < width)
+						v = std::max(v, o.w*im(sr, sc));
 				}
+
+				rv(r, c) = v;
 			}
+		}
+	} else {
+		for (float t : values) {
+			if (t <= 0)
+				continue;
 
-			*dest++ = v;
+			const image<float> d = squared_distance(im, t);
+
+			for (size_t i = 0; i < rv.pixels.size(); i++) {
+				if (d.pixels[i] < max_distance)
+					rv.pixels[i] = std::max(rv.pixels[i], t*disc_weight(sqrtf(d.pixels[i]), radius));
+			}
 		}
 	}
 
@@ -68,15 +94,29 @@ glyph::glyph(wchar_t code, int left, int top, int advance_x, std::unique_ptr<ima
 , left_ { left }
 , top_ { top }
 , advance_x_ { advance_x }
+, size_ { 0 }
+{ }
+
+glyph::glyph(wchar_t code, const glyph *other)
+: sprite_base { other }
+, code_ { code }
+, left_ { other->left_ }
+, top_ { other->top_ }
+, advance_x_ { other->advance_x_ }
+, size_ { other->size_ }
 { }
 
 void
-glyph::serialize(TiXmlElement *el) const
+glyph::serialize(attribute_sink& out) const
 {
-	el->SetAttribute("code", code_);
-	el->SetAttribute("left", left_);
-	el->SetAttribute("top", top_);
-	el->SetAttribute("advancex", advance_x_);
+	out.attribute("code", code_);
+
+	if (size_)
+		out.attribute("size", size_);
+
+	out.attribute("left", left_);
+	out.attribute("top", top_);
+	out.attribute("advancex", advance_x_);
 }
 
 class ft_library
@@ -110,18 +150,40 @@ ft_library::get_instance()
 }
 
 font::font(const char *path)
-: outline_radius_ { 2 }
+: path_ { path }
+, char_size_ { 0 }
+, outline_radius_ { 2 }
 , inner_color_fn_ { [](float) { return rgba<int> { 255, 255, 255, 255 }; } }
 , outer_color_fn_ { [](float) { return rgba<int> { 0, 0, 0, 255 }; } }
 , shadow_dx_ { 0 }
 , shadow_dy_ { 0 }
 , shadow_opacity_ { .2 }
 , shadow_blur_radius_ { 0 }
+, distance_field_spread_ { 0 }
 {
 	if (FT_New_Face(ft_library::get_instance(), path, 0, &face_) != 0)
 		panic("FT_New_Face");
 }
 
+font::font(const font& other)
+: path_ { other.path_ }
+, char_size_ { 0 }
+, outline_radius_ { other.outline_radius_ }
+, inner_color_fn_ { other.inner_color_fn_ }
+, outer_color_fn_ { other.outer_color_fn_ }
+, shadow_dx_ { other.shadow_dx_ }
+, shadow_dy_ { other.shadow_dy_ }
+, shadow_opacity_ { other.shadow_opacity_ }
+, shadow_blur_radius_ { other.shadow_blur_radius_ }
+, distance_field_spread_ { other.distance_field_spread_ }
+{
+	if (FT_New_Face(ft_library::get_instance(), path_.c_str(), 0, &face_) != 0)
+		panic("FT_New_Face");
+
+	if (other.char_size_)
+		set_char_size(other.char_size_);
+}
+
 font::~font()
 {
 	FT_Done_Face(face_);
@@ -130,7 +192,22 @@ font::~font()
 void
 font::set_char_size(int size)
 {
-	if (FT_Set_Char_Size(face_, size << 6, 0, 100, 0) != 0)
+	char_size_ = size;
+	apply_char_size();
+}
+
+int
+font::char_size() const
+{
+	return char_size_;
+}
+
+void
+font::apply_char_size()
+{
+	const int scale = distance_field_spread_ ? distance_field_scale : 1;
+
+	if (FT_Set_Char_Size(face_, (char_size_*scale) << 6, 0, 100, 0) != 0)
 		panic("FT_Set_Char_Size");
 }
 
@@ -171,9 +248,47 @@ font::set_shadow_blur_radius(int v)
 	shadow_blur_radius_ = v;
 }
 
-std::unique_ptr<sprite_base>
+void
+font::set_distance_field(int spread)
+{
+	distance_field_spread_ = spread;
+
+	if (char_size_)
+		apply_char_size();
+}
+
+FT_UInt
+font::glyph_index(wchar_t code) const
+{
+	return FT_Get_Char_Index(face_, code);
+}
+
+bool
+font::has_kerning() const
+{
+	return FT_HAS_KERNING(face_);
+}
+
+int
+font::kerning(FT_UInt left, FT_UInt right) const
+{
+	FT_Vector delta;
+
+	if (FT_Get_Kerning(face_, left, right, FT_KERNING_UNFITTED, &delta) != 0)
+		panic("FT_Get_Kerning");
+
+	// the face is bigger when rendering distance fields
+	const int scale = distance_field_spread_ ? distance_field_scale : 1;
+
+	return (delta.x/scale + 32) >> 6;
+}
+
+std::unique_ptr<glyph>
 font::render_glyph(wchar_t code)
 {
+	if (distance_field_spread_)
+		return render_distance_field(code);
+
 	const auto& bbox = face_->bbox;
 
 	const auto y_min = bbox.yMin >> 6;
@@ -273,7 +388,8 @@ font::render_glyph(wchar_t code)
 		shadow.copy(alpha, shadow_dy_, shadow_dx_);
 		shadow *= shadow_opacity_;
 
-		shadow.gaussian_blur(shadow_blur_radius_);
+		// the blur fades out within the margin left for it
+		shadow.gaussian_blur(shadow_blur_radius_/3.f);
 
 		for (size_t i = 0u; i < dest_width*dest_height; i++) {
 			auto s = shadow.pixels[i];
@@ -296,5 +412,96 @@ font::render_glyph(wchar_t code)
 	}
 
 	std::unique_ptr<image<uint32_t>> im { new image<uint32_t> { color_glyph*255.f } };
-	return std::unique_ptr<sprite_base> { new glyph { code, left, top, advance_x, std::move(im) } };
+	return std::unique_ptr<glyph> { new glyph { code, left, top, advance_x, std::move(im) } };
+}
+
+std::unique_ptr<glyph>
+font::render_distance_field(wchar_t code)
+{
+	const int scale = distance_field_scale;
+
+	if ((FT_Load_Char(face_, code, FT_LOAD_RENDER)) != 0)
+		panic("FT_Load_Char");
+
+	FT_GlyphSlot slot = face_->glyph;
+
+	const FT_Glyph_Metrics *metrics = &slot->metrics;
+	const int advance_x = (metrics->horiAdvance/scale) >> 6;
+
+	FT_Bitmap *bitmap = &slot->bitmap;
+
+	const int src_height = bitmap->rows;
+	const int src_width = bitmap->pitch;
+
+	// smallest block of pixels at the final size that holds the glyph;
+	// like the outline, the spread is added on every side
+
+	auto floor_div = [=](int v) { return v >= 0 ? v/scale : -((-v + scale - 1)/scale); };
+	auto ceil_div = [=](int v) { return -floor_div(-v); };
+
+	const int left = floor_div(slot->bitmap_left);
+	const int right = ceil_div(slot->bitmap_left + src_width);
+	const int top = ceil_div(slot->bitmap_top);
+	const int bottom = floor_div(slot->bitmap_top - src_height);
+
+	const int spread = distance_field_spread_;
+	const int dest_width = right - left + 2*spread;
+	const int dest_height = top - bottom + 2*spread;
+
+	image<float> orig(src_width, src_height, bitmap->buffer);
+	orig *= 1.f/255;
+
+	image<float> lum(dest_width*scale, dest_height*scale);
+	lum.copy(orig, (top + spread)*scale - slot->bitmap_top, slot->bitmap_left - (left - spread)*scale);
+
+	// distance from each pixel outside to the glyph and from each pixel
+	// inside to the outside, less half a pixel to get the distance to the
+	// edge between them
+
+	const image<float> to_inside = squared_distance(lum, .5f);
+
+	image<float> outside(lum);
+	std::transform(
+		std::begin(outside.pixels),
+		std::end(outside.pixels),
+		std::begin(outside.pixels),
+		[](float v) { return 1.f - v; });
+
+	const image<float> to_outside = squared_distance(outside, .5f);
+
+	// average the signed distance over each block, scaled down to the
+	// final size and mapped so that .5 is the edge and the glyph is above
+
+	image<float> field(dest_width, dest_height);
+
+	for (int i = 0; i < dest_height; i++) {
+		for (int j = 0; j < dest_width; j++) {
+			float sum = 0;
+
+			for (int r = i*scale; r < (i + 1)*scale; r++) {
+				for (int c = j*scale; c < (j + 1)*scale; c++) {
+					const float d_in = to_inside(r, c);
+
+					if (d_in > 0)
+						sum -= sqrtf(d_in) - .5f;
+					else
+						sum += sqrtf(to_outside(r, c)) - .5f;
+				}
+			}
+
+			const float d = sum/(scale*scale*scale);
+			field(i, j) = std::min(std::max(.5f + .5f*d/spread, 0.f), 1.f);
+		}
+	}
+
+	image<rgba<float>> color_glyph(dest_width, dest_height);
+
+	std::transform(
+		std::begin(field.pixels),
+		std::end(field.pixels),
+		std::begin(color_glyph.pixels),
+		[](float v) { return rgba<float> { v, v, v, v }; });
+
+	std::unique_ptr<image<uint32_t>> im { new image<uint32_t> { color_glyph*255.f } };
+	return std::unique_ptr<glyph> { new glyph { code, left, top, advance_x, std::move(im) } };
 }
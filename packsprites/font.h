@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <functional>
 
 #include <ft2build.h>
@@ -13,10 +14,16 @@ struct glyph : sprite_base
 {
 	glyph(wchar_t code, int left, int top, int advance_x, std::unique_ptr<image<uint32_t>> im);
 
-	void serialize(TiXmlElement *el) const override;
+	// another code point for the same glyph of the font
+	glyph(wchar_t code, const glyph *other);
+
+	void serialize(attribute_sink& out) const override;
 
 	wchar_t code_;
 	int left_, top_, advance_x_;
+
+	// font size, for sheets with several; 0 isn't written out
+	int size_;
 };
 
 using color_fn = std::function<rgba<int>(float)>;
@@ -25,9 +32,17 @@ class font
 {
 public:
 	font(const char *path);
+
+	// opens the font file again, with the same settings: FreeType faces
+	// can't be shared between threads
+	font(const font& other);
+
 	virtual ~font();
 
+	font& operator=(const font&) = delete;
+
 	void set_char_size(int size);
+	int char_size() const;
 	void set_outline_radius(int v);
 	void set_inner_color_fn(const color_fn& fn);
 	void set_outer_color_fn(const color_fn& fn);
@@ -35,7 +50,21 @@ public:
 	void set_shadow_opacity(float v);
 	void set_shadow_blur_radius(int v);
 
-	std::unique_ptr<sprite_base> render_glyph(const wchar_t code);
+	// render signed distance fields instead of the glyph images: spread is
+	// the distance, in pixels, from the edge to either end of the range
+	// of values. the colors, outline and shadow are ignored
+	void set_distance_field(int spread);
+
+	// index of the glyph for the code point in the font, 0 if it has none
+	FT_UInt glyph_index(wchar_t code) const;
+
+	// whether the font has a kerning table
+	bool has_kerning() const;
+
+	// kerning between two glyphs, by glyph index, in pixels
+	int kerning(FT_UInt left, FT_UInt right) const;
+
+	std::unique_ptr<glyph> render_glyph(const wchar_t code);
 #if 0
 			const wchar_t code,
 			const color_fn& inner_color,
@@ -43,11 +72,17 @@ public:
 #endif
 
 private:
+	void apply_char_size();
+	std::unique_ptr<glyph> render_distance_field(const wchar_t code);
+
+	std::string path_;
 	FT_Face face_;
+	int char_size_;
 	int outline_radius_;
 	color_fn inner_color_fn_;
 	color_fn outer_color_fn_;;
 	int shadow_dx_, shadow_dy_;
 	float shadow_opacity_;
 	int shadow_blur_radius_;
+	int distance_field_spread_;
 };
@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "hash.h"
+#include "panic.h"
+#include "font.h"
+#include "glyph_cache.h"
+
+namespace {
+
+// bump when the way glyphs are rendered changes, so that older files are
+// ignored
+const uint32_t cache_version = 3;
+
+const uint32_t cache_magic = 0x43594c47; // "GLYC"
+
+// in native byte order, followed by the pixels; a file written on a
+// machine with another byte order doesn't match the magic and is ignored
+struct cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	int32_t code, size;
+	int32_t left, top, advance_x;
+	uint32_t width, height;
+};
+
+uint64_t
+file_hash(const std::string& path)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+
+	if (!f)
+		panic("fopen %s failed: %s", path.c_str(), strerror(errno));
+
+	std::vector<char> data;
+
+	char buf[64*1024];
+	size_t size;
+
+	while ((size = fread(buf, 1, sizeof buf, f)) > 0)
+		data.insert(std::end(data), buf, buf + size);
+
+	fclose(f);
+
+	return hash64(data.data(), data.size());
+}
+
+} // (anonymous namespace)
+
+glyph_cache::glyph_cache(const std::string& dir, const std::string& font_path, const std::string& settings)
+: dir_ { dir }
+, key_ { hash64(settings.data(), settings.size(), file_hash(font_path)) }
+{
+	if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+		panic("mkdir %s failed: %s", dir.c_str(), strerror(errno));
+}
+
+std::string
+glyph_cache::path(wchar_t code, int size) const
+{
+	const uint32_t c = code;
+	const uint32_t s = size;
+	const uint8_t bytes[] = {
+		static_cast<uint8_t>(c), static_cast<uint8_t>(c >> 8), static_cast<uint8_t>(c >> 16), static_cast<uint8_t>(c >> 24),
+		static_cast<uint8_t>(s), static_cast<uint8_t>(s >> 8), static_cast<uint8_t>(s >> 16), static_cast<uint8_t>(s >> 24) };
+
+	char name[32];
+	snprintf(name, sizeof name, "%016" PRIx64 ".glyph", hash64(bytes, sizeof bytes, key_));
+
+	return dir_ + "/" + name;
+}
+
+std::unique_ptr<glyph>
+glyph_cache::get(wchar_t code, int size) const
+{
+	FILE *f = fopen(path(code, size).c_str(), "rb");
+
+	if (!f)
+		return nullptr;
+
+	std::unique_ptr<glyph> rv;
+
+	// anything unexpected is a miss, and the file gets written again
+	cache_header header;
+
+	if (fread(&header, sizeof header, 1, f) == 1 &&
+		header.magic == cache_magic &&
+		header.version == cache_version &&
+		header.key == key_ &&
+		header.code == static_cast<int32_t>(code) &&
+		header.size == size) {
+		std::unique_ptr<image<uint32_t>> im { new image<uint32_t>(header.width, header.height) };
+
+		if (fread(im->pixels.data(), sizeof(uint32_t), im->pixels.size(), f) == im->pixels.size())
+			rv.reset(new glyph { code, header.left, header.top, header.advance_x, std::move(im) });
+	}
+
+	fclose(f);
+
+	return rv;
+}
+
+void
+glyph_cache::put(const glyph& g, int size) const
+{
+	const std::string path = this->path(g.code_, size);
+
+	// written under another name first, so that a concurrent run never
+	// reads half a file
+	const std::string temp_path = path + "." + std::to_string(getpid());
+
+	FILE *f = fopen(temp_path.c_str(), "wb");
+
+	if (!f)
+		panic("fopen %s for write failed: %s", temp_path.c_str(), strerror(errno));
+
+	const auto& im = *g.image_;
+
+	cache_header header;
+	header.magic = cache_magic;
+	header.version = cache_version;
+	header.key = key_;
+	header.code = g.code_;
+	header.size = size;
+	header.left = g.left_;
+	header.top = g.top_;
+	header.advance_x = g.advance_x_;
+	header.width = im.width;
+	header.height = im.height;
+
+	if (fwrite(&header, sizeof header, 1, f) != 1 ||
+		fwrite(im.pixels.data(), sizeof(uint32_t), im.pixels.size(), f) != im.pixels.size())
+		panic("write failed: %s", strerror(errno));
+
+	if (fclose(f) != 0)
+		panic("write failed: %s", strerror(errno));
+
+	if (rename(temp_path.c_str(), path.c_str()) != 0)
+		panic("rename %s failed: %s", temp_path.c_str(), strerror(errno));
+}
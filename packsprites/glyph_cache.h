@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+struct glyph;
+
+// finished glyph images, kept in a directory across runs. each glyph is a
+// file named after a hash of the font file, the rendering settings, its
+// size and its code point, so glyphs rendered with other settings are
+// never mixed up
+class glyph_cache
+{
+public:
+	// settings describes everything but the size and code point the glyphs
+	// depend on
+	glyph_cache(const std::string& dir, const std::string& font_path, const std::string& settings);
+
+	// null if the glyph isn't in the cache
+	std::unique_ptr<glyph> get(wchar_t code, int size) const;
+
+	// safe to call from several threads, for different glyphs
+	void put(const glyph& g, int size) const;
+
+private:
+	std::string path(wchar_t code, int size) const;
+
+	std::string dir_;
+	uint64_t key_;
+};
@@ -0,0 +1,105 @@
+#include <cstring>
+
+#include "hash.h"
+
+namespace {
+
+const uint64_t prime1 = 11400714785074694791ULL;
+const uint64_t prime2 = 14029467366897019727ULL;
+const uint64_t prime3 = 1609587929392839161ULL;
+const uint64_t prime4 = 9650029242287828579ULL;
+const uint64_t prime5 = 2870177450012600261ULL;
+
+inline uint64_t
+rotl(uint64_t v, int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+inline uint64_t
+read64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+inline uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+inline uint64_t
+round64(uint64_t acc, uint64_t input)
+{
+	acc += input*prime2;
+	acc = rotl(acc, 31);
+	return acc*prime1;
+}
+
+inline uint64_t
+merge_round(uint64_t acc, uint64_t v)
+{
+	acc ^= round64(0, v);
+	return acc*prime1 + prime4;
+}
+
+} // (anonymous namespace)
+
+uint64_t
+hash64(const void *data, size_t size, uint64_t seed)
+{
+	// assumes a little-endian host, like the rest of the pixel code
+
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+	const uint8_t *end = p + size;
+
+	uint64_t h;
+
+	if (size >= 32) {
+		uint64_t v1 = seed + prime1 + prime2;
+		uint64_t v2 = seed + prime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - prime1;
+
+		do {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	} else {
+		h = seed + prime5;
+	}
+
+	h += size;
+
+	for (; p + 8 <= end; p += 8)
+		h = rotl(h ^ round64(0, read64(p)), 27)*prime1 + prime4;
+
+	if (p + 4 <= end) {
+		h = rotl(h ^ (read32(p)*prime1), 23)*prime2 + prime3;
+		p += 4;
+	}
+
+	for (; p < end; p++)
+		h = rotl(h ^ (*p*prime5), 11)*prime1;
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+
+	return h;
+}
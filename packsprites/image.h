@@ -76,65 +76,110 @@ struct image
 			std::copy(&other(r - dr, c0 - dc), &other(r - dr, c1 - dc), &(*this)(r, c0));
 	}
 
-	void
-	gaussian_blur(int radius)
+	image<T>
+	sub_image(int r, int c, size_t sub_width, size_t sub_height) const
 	{
-		// generate kernel
+		image<T> rv(sub_width, sub_height);
+
+		for (size_t i = 0; i < sub_height; i++)
+			std::copy(&(*this)(r + i, c), &(*this)(r + i, c + sub_width), &rv(i, 0));
+
+		return rv;
+	}
 
-		std::vector<float> kernel(2*radius + 1);
+	// turned 90 degrees clockwise
+	image<T>
+	rotated() const
+	{
+		image<T> rv(height, width);
 
-		for (int i = 0; i < kernel.size(); i++) {
-			float f = i - radius;
-			kernel[i] = expf(-f*f/30.);
+		for (size_t r = 0; r < height; r++) {
+			for (size_t c = 0; c < width; c++)
+				rv(c, height - 1 - r) = (*this)(r, c);
 		}
 
-		float s = std::accumulate(std::begin(kernel), std::end(kernel), 0.f);
+		return rv;
+	}
 
-		std::transform(
-			std::begin(kernel),
-			std::end(kernel),
-			std::begin(kernel),
-			[=](float v) { return v/s; });
+	image<T>
+	transposed() const
+	{
+		image<T> rv(height, width);
 
-		// blur horizontally to temp
+		for (size_t r = 0; r < height; r++) {
+			for (size_t c = 0; c < width; c++)
+				rv(c, r) = (*this)(r, c);
+		}
 
-		std::vector<T> temp(width*height);
+		return rv;
+	}
 
-		for (int i = 0; i < height; i++) {
-			T *src = &pixels[i*width];
-			T *dest = &temp[i*width];
+	// approximated with three box blurs in each direction, so it costs
+	// the same whatever the sigma. pixels outside the image are zero
+	void
+	gaussian_blur(float sigma)
+	{
+		// box widths whose combined variance is closest to sigma^2, from
+		// Kovesi, "Fast Almost-Gaussian Filtering"
 
-			for (int j = 0; j < width; j++) {
-				T s = 0;
+		const int passes = 3;
 
-				for (int k = 0; k < kernel.size(); k++) {
-					if (j + k - radius < 0 || j + k - radius >= width)
-						continue;
-					s += kernel[k]*src[k - radius];
-				}
+		int w = sqrtf(12*sigma*sigma/passes + 1);
+		if (w % 2 == 0)
+			--w;
 
-				*dest++ = s;
-				++src;
-			}
-		}
+		const int m = roundf((12*sigma*sigma - passes*w*w - 4*passes*w - 3*passes)/(-4*w - 4));
 
-		// blur vertically from temp
+		int radius[passes];
+		for (int i = 0; i < passes; i++)
+			radius[i] = (i < m ? w : w + 2)/2;
 
-		for (int i = 0; i < height; i++) {
-			T *src = &temp[i*width];
-			T *dest = &pixels[i*width];
+		for (int i = 0; i < passes; i++)
+			box_blur_columns(radius[i]);
 
-			for (int j = 0; j < width; j++) {
-				T s = 0;
+		*this = transposed();
 
-				for (int k = 0; k < kernel.size(); k++) {
-					if (i + k - radius < 0 || i + k - radius >= height)
-						continue;
-					s += kernel[k]*src[(k - radius)*width];
-				}
+		for (int i = 0; i < passes; i++)
+			box_blur_columns(radius[i]);
+
+		*this = transposed();
+	}
+
+	// each pixel becomes the average of the 2*radius + 1 pixels around it
+	// in its column. the running sums are kept for a whole row at a time,
+	// so the inner loop has no dependencies between iterations
+	void
+	box_blur_columns(int radius)
+	{
+		if (radius == 0)
+			return;
+
+		// rows of zeros above and below, so there's no bounds checking
+		const size_t pad = radius + 1;
+
+		std::vector<T> src((height + 2*pad)*width);
+		std::copy(std::begin(pixels), std::end(pixels), &src[pad*width]);
+
+		// sum for row -1
+		std::vector<T> sum(width);
+
+		for (int i = 0; i <= 2*radius; i++) {
+			const T *row = &src[i*width];
+
+			for (size_t j = 0; j < width; j++)
+				sum[j] += row[j];
+		}
+
+		const float scale = 1.f/(2*radius + 1);
+
+		for (size_t i = 0; i < height; i++) {
+			const T *add = &src[(i + pad + radius)*width];
+			const T *sub = &src[(i + pad - radius - 1)*width];
+			T *dest = &pixels[i*width];
 
-				*dest++ = s;
-				++src;
+			for (size_t j = 0; j < width; j++) {
+				sum[j] += add[j] - sub[j];
+				dest[j] = sum[j]*scale;
 			}
 		}
 	}
@@ -0,0 +1,222 @@
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+
+#include "sprite_base.h"
+#include "maxrects_packer.h"
+
+namespace {
+
+int
+common_interval_length(int start0, int end0, int start1, int end1)
+{
+	if (end0 < start1 || end1 < start0)
+		return 0;
+	return std::min(end0, end1) - std::max(start0, start1);
+}
+
+} // (anonymous namespace)
+
+maxrects_packer::maxrects_packer(int width, int height, bool allow_rotation, heuristic h)
+: width_ { width }
+, height_ { height }
+, allow_rotation_ { allow_rotation }
+, heuristic_ { h }
+, free_rects_ { rect { 0, 0, width, height } }
+{ }
+
+bool
+maxrects_packer::insert(const sprite_base *sp, int border)
+{
+	rect rc;
+	bool rotated;
+
+	if (!find_position(sp->width() + 2*border, sp->height() + 2*border, rc, rotated))
+		return false;
+
+	place(rc);
+
+	sprite_rects_.push_back({ sp, rect { rc.left_ + border, rc.top_ + border, rc.width_ - 2*border, rc.height_ - 2*border }, rotated });
+
+	return true;
+}
+
+std::vector<sprite_rect>
+maxrects_packer::sprite_rects() const
+{
+	return sprite_rects_;
+}
+
+void
+maxrects_packer::reserve(const sprite_rect& p, int border)
+{
+	const auto& rc = p.rc_;
+
+	place(rect { rc.left_ - border, rc.top_ - border, rc.width_ + 2*border, rc.height_ + 2*border });
+
+	sprite_rects_.push_back(p);
+}
+
+bool
+maxrects_packer::find_position(int width, int height, rect& rc, bool& rotated) const
+{
+	// lower scores are better, ties are broken by the second score
+
+	int best_score0 = INT_MAX;
+	int best_score1 = INT_MAX;
+
+	auto try_position = [&](const rect& free_rc, int width, int height, bool is_rotated)
+		{
+			if (free_rc.width_ < width || free_rc.height_ < height)
+				return;
+
+			const int leftover_horiz = free_rc.width_ - width;
+			const int leftover_vert = free_rc.height_ - height;
+
+			const rect candidate { free_rc.left_, free_rc.top_, width, height };
+
+			int score0, score1;
+
+			switch (heuristic_) {
+				case heuristic::best_short_side_fit:
+					score0 = std::min(leftover_horiz, leftover_vert);
+					score1 = std::max(leftover_horiz, leftover_vert);
+					break;
+
+				case heuristic::best_area_fit:
+					score0 = free_rc.width_*free_rc.height_ - width*height;
+					score1 = std::min(leftover_horiz, leftover_vert);
+					break;
+
+				case heuristic::bottom_left:
+					score0 = candidate.bottom();
+					score1 = candidate.left_;
+					break;
+
+				case heuristic::contact_point:
+				default:
+					score0 = -contact_score(candidate);
+					score1 = 0;
+					break;
+			}
+
+			if (score0 < best_score0 || (score0 == best_score0 && score1 < best_score1)) {
+				best_score0 = score0;
+				best_score1 = score1;
+				rc = candidate;
+				rotated = is_rotated;
+			}
+		};
+
+	for (const auto& free_rc : free_rects_) {
+		try_position(free_rc, width, height, false);
+
+		if (allow_rotation_ && width != height)
+			try_position(free_rc, height, width, true);
+	}
+
+	return best_score0 != INT_MAX;
+}
+
+int
+maxrects_packer::contact_score(const rect& rc) const
+{
+	int score = 0;
+
+	// sheet edges count as contact too
+
+	if (rc.left_ == 0 || rc.right() == width_)
+		score += rc.height_;
+
+	if (rc.top_ == 0 || rc.bottom() == height_)
+		score += rc.width_;
+
+	for (const auto& used_rc : used_rects_) {
+		if (used_rc.left_ == rc.right() || used_rc.right() == rc.left_)
+			score += common_interval_length(used_rc.top_, used_rc.bottom(), rc.top_, rc.bottom());
+
+		if (used_rc.top_ == rc.bottom() || used_rc.bottom() == rc.top_)
+			score += common_interval_length(used_rc.left_, used_rc.right(), rc.left_, rc.right());
+	}
+
+	return score;
+}
+
+void
+maxrects_packer::place(const rect& rc)
+{
+	std::vector<rect> free_rects;
+	free_rects.swap(free_rects_);
+
+	for (const auto& free_rc : free_rects) {
+		if (!free_rc.intersects(rc))
+			free_rects_.push_back(free_rc);
+	}
+
+	const size_t first_new = free_rects_.size();
+
+	for (const auto& free_rc : free_rects) {
+		if (free_rc.intersects(rc))
+			split_free_rect(free_rc, rc);
+	}
+
+	prune_free_rects(first_new);
+
+	used_rects_.push_back(rc);
+}
+
+void
+maxrects_packer::split_free_rect(const rect& free_rc, const rect& used_rc)
+{
+	// up to four maximal rectangles around the used one
+
+	if (used_rc.left_ > free_rc.left_)
+		free_rects_.emplace_back(free_rc.left_, free_rc.top_, used_rc.left_ - free_rc.left_, free_rc.height_);
+
+	if (used_rc.right() < free_rc.right())
+		free_rects_.emplace_back(used_rc.right(), free_rc.top_, free_rc.right() - used_rc.right(), free_rc.height_);
+
+	if (used_rc.top_ > free_rc.top_)
+		free_rects_.emplace_back(free_rc.left_, free_rc.top_, free_rc.width_, used_rc.top_ - free_rc.top_);
+
+	if (used_rc.bottom() < free_rc.bottom())
+		free_rects_.emplace_back(free_rc.left_, used_rc.bottom(), free_rc.width_, free_rc.bottom() - used_rc.bottom());
+}
+
+void
+maxrects_packer::prune_free_rects(size_t first_new)
+{
+	// drop free rectangles contained in some other one; the ones that were
+	// there before the split can't contain each other, so only pairs with at
+	// least one new rectangle need to be checked
+
+	const size_t count = free_rects_.size();
+	std::vector<bool> redundant(count);
+
+	for (size_t i = 0; i < count; i++) {
+		if (redundant[i])
+			continue;
+
+		for (size_t j = std::max(i + 1, first_new); j < count; j++) {
+			if (redundant[j])
+				continue;
+
+			if (free_rects_[j].contains(free_rects_[i])) {
+				redundant[i] = true;
+				break;
+			}
+
+			if (free_rects_[i].contains(free_rects_[j]))
+				redundant[j] = true;
+		}
+	}
+
+	size_t n = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		if (!redundant[i])
+			free_rects_[n++] = free_rects_[i];
+	}
+
+	free_rects_.resize(n);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "packer.h"
+
+// maximal rectangles packer: keeps the list of all maximal free rectangles
+// and places each sprite in the one picked by the heuristic
+
+class maxrects_packer : public packer
+{
+public:
+	enum class heuristic
+	{
+		best_short_side_fit,
+		best_area_fit,
+		bottom_left,
+		contact_point,
+	};
+
+	maxrects_packer(int width, int height, bool allow_rotation, heuristic h);
+
+	bool insert(const sprite_base *sp, int border) override;
+	std::vector<sprite_rect> sprite_rects() const override;
+	void reserve(const sprite_rect& p, int border) override;
+
+private:
+	bool find_position(int width, int height, rect& rc, bool& rotated) const;
+	int contact_score(const rect& rc) const;
+	void place(const rect& rc);
+	void split_free_rect(const rect& free_rc, const rect& used_rc);
+	void prune_free_rects(size_t first_new);
+
+	int width_, height_;
+	bool allow_rotation_;
+	heuristic heuristic_;
+	std::vector<rect> free_rects_;
+	std::vector<rect> used_rects_;
+	std::vector<sprite_rect> sprite_rects_;
+};
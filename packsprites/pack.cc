@@ -1,227 +1,1015 @@
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <cinttypes>
 #include <utility>
+#include <cstdlib>
 #include <sstream>
-#include <functional>
+#include <numeric>
 #include <algorithm>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <tinyxml.h>
 
 #include "sprite_base.h"
 #include "png_util.h"
+#include "parallel.h"
 #include "panic.h"
+#include "sheet_writer.h"
+#include "sprite_binary.h"
+#include "sprite_header.h"
 #include "pack.h"
 
 namespace {
 
-struct rect
-{
-	rect(int left, int top, int width, int height)
-	: left_(left), top_(top), width_(width), height_(height)
-	{ }
-
-	int left_, top_, width_, height_;
+// sheet sizes picked by the automatic size search are multiples of this,
+// which keeps block-compressed texture formats happy
+const int auto_size_step = 4;
 
-	std::pair<rect, rect> split_vert(int c) const;
-	std::pair<rect, rect> split_horiz(int r);
+struct sheet
+{
+	int width_, height_;
+	std::vector<sprite_rect> sprite_rects_;
 };
 
-std::pair<rect, rect>
-rect::split_vert(int c) const
-{
-	assert(c < width_);
-	return std::pair<rect, rect>(rect(left_, top_, c, height_), rect(left_ + c, top_, width_ - c, height_));
-}
+// a sprite at least as big as one that didn't fit won't fit either
 
-std::pair<rect, rect>
-rect::split_horiz(int r)
+bool
+known_not_to_fit(const std::vector<std::pair<size_t, size_t>>& failed_sizes, const sprite_base *sp)
 {
-	assert(r < height_);
-	return std::pair<rect, rect>(rect(left_, top_, width_, r), rect(left_, top_ + r, width_, height_ - r));
+	const auto width = sp->width();
+	const auto height = sp->height();
+
+	return std::any_of(
+			std::begin(failed_sizes),
+			std::end(failed_sizes),
+			[=](const std::pair<size_t, size_t>& size)
+			{
+				return size.first <= width && size.second <= height;
+			});
 }
 
-struct node
+// keeps all the sheets open and puts each sprite, in order, in the first
+// sheet that takes it, trying the fullest sheets first for best fit; opens a
+// new sheet when none does
+
+bool
+pack_open_sheets(const std::vector<const sprite_base *>& sprites,
+		const pack_options& options,
+		int width, int height,
+		size_t max_sheets,
+		std::vector<sheet>& sheets)
 {
-	node(const rect& rc)
-	: rc_(rc), border_(0), sprite_(0)
-	{ }
+	struct open_sheet
+	{
+		std::unique_ptr<packer> packer_;
+		long used_area_;
+		std::vector<std::pair<size_t, size_t>> failed_sizes_;
+	};
+
+	std::vector<open_sheet> open_sheets;
+	std::vector<size_t> order;
+
+	for (auto sp : sprites) {
+		const long area = static_cast<long>(sp->width() + 2*options.border)*(sp->height() + 2*options.border);
+
+		order.resize(open_sheets.size());
+		std::iota(std::begin(order), std::end(order), 0);
+
+		if (options.fill == sheet_fill::best_fit) {
+			std::stable_sort(
+				std::begin(order),
+				std::end(order),
+				[&](size_t a, size_t b)
+				{
+					return open_sheets[a].used_area_ > open_sheets[b].used_area_;
+				});
+		}
 
-	bool insert(const sprite_base *sp, int border);
+		auto it = std::find_if(
+				std::begin(order),
+				std::end(order),
+				[&](size_t i)
+				{
+					auto& s = open_sheets[i];
 
-	rect rc_;
-	int border_;
-	const sprite_base *sprite_;
-	std::unique_ptr<node> left_, right_;
-};
+					if (known_not_to_fit(s.failed_sizes_, sp))
+						return false;
+
+					if (!s.packer_->insert(sp, options.border)) {
+						s.failed_sizes_.emplace_back(sp->width(), sp->height());
+						return false;
+					}
+
+					return true;
+				});
+
+		if (it != std::end(order)) {
+			open_sheets[*it].used_area_ += area;
+		} else {
+			if (open_sheets.size() == max_sheets)
+				return false;
+
+			auto packer = make_packer(options.packer, width, height, options.allow_rotation);
+
+			if (!packer->insert(sp, options.border))
+				return false;
+
+			open_sheets.push_back({ std::move(packer), area, {} });
+		}
+	}
+
+	for (const auto& s : open_sheets)
+		sheets.push_back({ width, height, s.packer_->sprite_rects() });
+
+	return true;
+}
+
+// packs the sprites, in order, into as many width x height sheets as needed;
+// fails if some sprite doesn't fit on an empty sheet or if more than
+// max_sheets sheets would be needed
 
 bool
-node::insert(const sprite_base *sp, int border)
+pack_sheets(std::vector<const sprite_base *> sprites,
+		const pack_options& options,
+		int width, int height,
+		size_t max_sheets,
+		std::vector<sheet>& sheets)
 {
-	if (left_ != NULL) {
-		// not a leaf
-		return left_->insert(sp, border) || right_->insert(sp, border);
-	} else {
-		const int wanted_width = sp->width() + 2*border;
-		const int wanted_height = sp->height() + 2*border;
+	sheets.clear();
 
-		// doesn't fit or already occupied
-		if (sprite_ || rc_.width_ < wanted_width || rc_.height_ < wanted_height) {
+	if (options.fill != sheet_fill::sequential)
+		return pack_open_sheets(sprites, options, width, height, max_sheets, sheets);
+
+	while (!sprites.empty()) {
+		if (sheets.size() == max_sheets)
 			return false;
-		}
 
-		if (rc_.width_ == wanted_width && rc_.height_ == wanted_height) {
-			sprite_ = sp;
-			border_ = border;
-			return true;
+		auto packer = make_packer(options.packer, width, height, options.allow_rotation);
+
+		// sprites that didn't fit stay in the same (sorted) order for the next sheet
+
+		std::vector<const sprite_base *> remaining_sprites;
+
+		std::vector<std::pair<size_t, size_t>> failed_sizes;
+
+		for (auto sp : sprites) {
+			bool skip = known_not_to_fit(failed_sizes, sp);
+
+			if (skip || !packer->insert(sp, options.border)) {
+				remaining_sprites.push_back(sp);
+
+				if (!skip)
+					failed_sizes.emplace_back(sp->width(), sp->height());
+			}
 		}
 
-		if (rc_.width_ - wanted_width > rc_.height_ - wanted_height) {
-			std::pair<rect, rect> child_rect = rc_.split_vert(wanted_width);
-			left_.reset(new node(child_rect.first));
-			right_.reset(new node(child_rect.second));
-		} else {
-			std::pair<rect, rect> child_rect = rc_.split_horiz(wanted_height);
-			left_.reset(new node(child_rect.first));
-			right_.reset(new node(child_rect.second));
+		if (remaining_sprites.size() == sprites.size())
+			return false;
+
+		sprites.swap(remaining_sprites);
+
+		sheets.push_back({ width, height, packer->sprite_rects() });
+	}
+
+	return true;
+}
+
+std::vector<int>
+candidate_sizes(int min_size, int max_size, bool power_of_two)
+{
+	std::vector<int> sizes;
+
+	if (power_of_two) {
+		for (int size = 1; size <= max_size; size *= 2) {
+			if (size >= min_size)
+				sizes.push_back(size);
 		}
+	} else {
+		for (int size = (min_size + auto_size_step - 1)/auto_size_step*auto_size_step; size < max_size; size += auto_size_step)
+			sizes.push_back(size);
 
-		bool rv = left_->insert(sp, border);
-		assert(rv);
-		return rv;
+		if (min_size <= max_size)
+			sizes.push_back(max_size);
 	}
+
+	return sizes;
+}
+
+// smallest sheet size that holds the sprites in as few sheets as the
+// maximum size (options.sheet_width x options.sheet_height) does
+
+std::vector<sheet>
+pack_auto_size(const std::vector<const sprite_base *>& sprites, const pack_options& options)
+{
+	int max_width = options.sheet_width;
+	int max_height = options.sheet_height;
+
+	if (options.square)
+		max_width = max_height = std::min(max_width, max_height);
+
+	if (options.power_of_two) {
+		max_width = candidate_sizes(1, max_width, true).back();
+		max_height = candidate_sizes(1, max_height, true).back();
+	}
+
+	std::vector<sheet> sheets;
+
+	if (!pack_sheets(sprites, options, max_width, max_height, sprites.size(), sheets))
+		panic("sprite too big for sheet");
+
+	const size_t num_sheets = sheets.size();
+
+	// lower bounds
+
+	int min_width = 1, min_height = 1;
+	long total_area = 0;
+
+	for (auto sp : sprites) {
+		int width = sp->width() + 2*options.border;
+		int height = sp->height() + 2*options.border;
+
+		if (options.allow_rotation && width > height)
+			std::swap(width, height);
+
+		min_width = std::max(min_width, width);
+		min_height = std::max(min_height, options.allow_rotation ? width : height);
+		total_area += static_cast<long>(width)*height;
+	}
+
+	if (options.square)
+		min_width = min_height = std::max(min_width, min_height);
+
+	struct candidate
+	{
+		int width_, height_;
+		std::vector<sheet> sheets_;
+	};
+
+	auto better = [](const candidate& a, const candidate& b)
+		{
+			const long area_a = static_cast<long>(a.width_)*a.height_;
+			const long area_b = static_cast<long>(b.width_)*b.height_;
+
+			if (area_a != area_b)
+				return area_a < area_b;
+
+			if (std::abs(a.width_ - a.height_) != std::abs(b.width_ - b.height_))
+				return std::abs(a.width_ - a.height_) < std::abs(b.width_ - b.height_);
+
+			return a.width_ < b.width_;
+		};
+
+	candidate best { max_width, max_height, std::move(sheets) };
+
+	// for each width, binary search the smallest height that still fits;
+	// every width is searched independently from the others so the result
+	// doesn't depend on how the threads were scheduled
+
+	auto search = [&](const std::vector<int>& widths, long max_area)
+		{
+			std::vector<candidate> results(widths.size());
+
+			parallel_for(widths.size(), options.num_threads, [&](size_t i)
+				{
+					const int width = widths[i];
+
+					std::vector<int> heights;
+
+					if (options.square) {
+						heights.push_back(width);
+					} else {
+						const int height_bound = std::max<long>(min_height, (total_area + width*num_sheets - 1)/(width*num_sheets));
+						heights = candidate_sizes(height_bound, max_height, options.power_of_two);
+					}
+
+					while (!heights.empty() && static_cast<long>(width)*heights.back() > max_area)
+						heights.pop_back();
+
+					auto& result = results[i];
+					result.width_ = result.height_ = 0;
+
+					size_t lo = 0, hi = heights.size();
+					std::vector<sheet> sheets;
+
+					while (lo < hi) {
+						const size_t mid = (lo + hi)/2;
+
+						if (pack_sheets(sprites, options, width, heights[mid], num_sheets, sheets)) {
+							result.width_ = width;
+							result.height_ = heights[mid];
+							result.sheets_ = std::move(sheets);
+							hi = mid;
+						} else {
+							lo = mid + 1;
+						}
+					}
+				});
+
+			for (auto& result : results) {
+				if (result.width_ && better(result, best))
+					best = std::move(result);
+			}
+		};
+
+	// a coarse pass over power of two widths gives an upper bound for the area,
+	// then all the other widths are tried against it
+
+	search(candidate_sizes(min_width, max_width, true), static_cast<long>(max_width)*max_height);
+
+	if (!options.power_of_two)
+		search(candidate_sizes(min_width, max_width, false), static_cast<long>(best.width_)*best.height_);
+
+	return std::move(best.sheets_);
+}
+
+size_t
+sort_key(const sprite_base *sp, sort_order order)
+{
+	switch (order) {
+		case sort_order::area:
+			return sp->width()*sp->height();
+
+		case sort_order::max_side:
+			return std::max(sp->width(), sp->height());
+
+		case sort_order::perimeter:
+			return sp->width() + sp->height();
+
+		case sort_order::height:
+			return sp->height();
+
+		case sort_order::width:
+			return sp->width();
+	}
+
+	return 0;
 }
 
 void
-write_sprite_sheet(image<uint32_t>& im, const node *root)
+sort_sprites(std::vector<const sprite_base *>& sprites, sort_order order)
+{
+	std::sort(
+		std::begin(sprites),
+		std::end(sprites),
+		[=](const sprite_base *a, const sprite_base *b)
+		{
+			return sort_key(b, order) < sort_key(a, order);
+		});
+}
+
+std::vector<sheet>
+pack_sprites(const std::vector<const sprite_base *>& sorted_sprites, const pack_options& options)
+{
+	std::vector<sheet> sheets;
+
+	if (options.auto_size) {
+		sheets = pack_auto_size(sorted_sprites, options);
+	} else if (!pack_sheets(sorted_sprites, options, options.sheet_width, options.sheet_height, sorted_sprites.size(), sheets)) {
+		panic("sprite too big for sheet");
+	}
+
+	if (options.shrink_last && !sheets.empty()) {
+		// repack the sprites of the last sheet on their own, with the
+		// last sheet as maximum size
+
+		const auto& last = sheets.back();
+
+		std::vector<const sprite_base *> last_sprites;
+
+		for (const auto& p : last.sprite_rects_)
+			last_sprites.push_back(p.sprite_);
+
+		sort_sprites(last_sprites, options.sort);
+
+		auto last_options = options;
+		last_options.sheet_width = last.width_;
+		last_options.sheet_height = last.height_;
+
+		auto shrunk = pack_auto_size(last_sprites, last_options);
+
+		// in a different order the sprites may not fit in one sheet anymore
+		if (shrunk.size() == 1)
+			sheets.back() = std::move(shrunk.front());
+	}
+
+	return sheets;
+}
+
+// fraction of the used part of each sheet (the bounding box of its sprites)
+// that is covered by sprites
+
+double
+occupancy(const std::vector<sheet>& sheets, int border)
+{
+	long sprite_area = 0;
+	long used_area = 0;
+
+	for (const auto& s : sheets) {
+		int right = 0, bottom = 0;
+
+		for (const auto& p : s.sprite_rects_) {
+			const auto& rc = p.rc_;
+
+			sprite_area += static_cast<long>(rc.width_ + 2*border)*(rc.height_ + 2*border);
+			right = std::max(right, rc.right() + border);
+			bottom = std::max(bottom, rc.bottom() + border);
+		}
+
+		used_area += static_cast<long>(right)*bottom;
+	}
+
+	return used_area ? static_cast<double>(sprite_area)/used_area : 0;
+}
+
+// packs with every packer and sort order and keeps the layout with the fewest
+// sheets, then the highest occupancy
+
+std::vector<sheet>
+pack_best(const std::vector<const sprite_base *>& sprites, const pack_options& options)
 {
-	if (root->left_) {
-		write_sprite_sheet(im, root->left_.get());
-		write_sprite_sheet(im, root->right_.get());
-	} else if (root->sprite_) {
-		const auto& child_im = root->sprite_->image_;
-		im.copy(*child_im, root->rc_.top_ + root->border_, root->rc_.left_ + root->border_);
+	static const sort_order sort_orders[] = {
+		sort_order::area,
+		sort_order::max_side,
+		sort_order::perimeter,
+		sort_order::height,
+		sort_order::width,
+	};
+
+	struct candidate
+	{
+		pack_options options_;
+		std::vector<sheet> sheets_;
+		double occupancy_;
+	};
+
+	std::vector<candidate> candidates;
+
+	for (auto type : all_packer_types()) {
+		for (auto order : sort_orders) {
+			candidate c { options };
+
+			c.options_.packer = type;
+			c.options_.sort = order;
+
+			// the candidates already keep every thread busy
+			c.options_.num_threads = 1;
+
+			candidates.push_back(std::move(c));
+		}
 	}
+
+	parallel_for(candidates.size(), options.num_threads, [&](size_t i)
+		{
+			auto& c = candidates[i];
+
+			auto sorted_sprites = sprites;
+			sort_sprites(sorted_sprites, c.options_.sort);
+
+			c.sheets_ = pack_sprites(sorted_sprites, c.options_);
+			c.occupancy_ = occupancy(c.sheets_, options.border);
+		});
+
+	// ties go to the earlier candidate, so the result doesn't depend on how
+	// the threads were scheduled
+
+	size_t best = 0;
+
+	for (size_t i = 1; i < candidates.size(); i++) {
+		const auto& a = candidates[i];
+		const auto& b = candidates[best];
+
+		if (a.sheets_.size() < b.sheets_.size() || (a.sheets_.size() == b.sheets_.size() && a.occupancy_ > b.occupancy_))
+			best = i;
+	}
+
+	return std::move(candidates[best].sheets_);
+}
+
+std::vector<sheet>
+pack_all(std::vector<const sprite_base *> sprites, const pack_options& options)
+{
+	if (options.try_all)
+		return pack_best(sprites, options);
+
+	sort_sprites(sprites, options.sort);
+	return pack_sprites(sprites, options);
 }
 
+std::string
+texture_name(const std::string& sheet_name, size_t i)
+{
+	std::stringstream ss;
+	ss << sheet_name << "." << i << ".png";
+	return ss.str();
+}
+
+bool
+file_exists(const std::string& path)
+{
+	if (FILE *f = fopen(path.c_str(), "rb")) {
+		fclose(f);
+		return true;
+	}
+
+	return false;
+}
+
+// starts from the layout of the previous run, as written to the .spr file
+// with hashes: sprites whose image didn't change stay where they were, the
+// others are packed in the space left on the old sheets and then on new
+// sheets. sheets that end up the same as before are flagged as unchanged.
+// returns false if there's no usable previous layout
+
+bool
+pack_incremental(const std::string& sheet_name,
+		const std::vector<const sprite_base *>& sprites,
+		const pack_options& options,
+		std::vector<sheet>& sheets,
+		std::vector<bool>& unchanged)
+{
+	TiXmlDocument doc;
+
+	if (!doc.LoadFile(sheet_name + ".spr"))
+		return false;
+
+	auto spritesheet_node = doc.RootElement();
+
+	if (!spritesheet_node)
+		return false;
+
+	auto textures_node = spritesheet_node->FirstChildElement("textures");
+	auto sprites_node = spritesheet_node->FirstChildElement("sprites");
+
+	if (!textures_node || !sprites_node)
+		return false;
+
+	// the sizes of the old sheets are in the textures
+
+	std::vector<std::pair<size_t, size_t>> sheet_sizes;
+
+	for (auto el = textures_node->FirstChildElement("texture"); el; el = el->NextSiblingElement("texture")) {
+		const auto path = texture_name(sheet_name, sheet_sizes.size());
+
+		if (!file_exists(path))
+			return false;
+
+		size_t width, height;
+		png_read_size(path, width, height);
+		sheet_sizes.emplace_back(width, height);
+	}
+
+	struct old_rect
+	{
+		size_t tex_;
+		rect rc_;
+		bool rotated_;
+		size_t width_, height_;
+		const sprite_base *sprite_; // the sprite kept there, if any
+	};
+
+	std::vector<old_rect> old_rects;
+	std::unordered_multimap<uint64_t, size_t> old_hashes;
+	std::unordered_set<uint64_t> positions;
+
+	for (auto el = sprites_node->FirstChildElement("sprite"); el; el = el->NextSiblingElement("sprite")) {
+		int x, y, w, h, tex, rotated = 0;
+
+		const char *hash = el->Attribute("hash");
+
+		if (!hash ||
+			el->QueryIntAttribute("x", &x) != TIXML_SUCCESS ||
+			el->QueryIntAttribute("y", &y) != TIXML_SUCCESS ||
+			el->QueryIntAttribute("w", &w) != TIXML_SUCCESS ||
+			el->QueryIntAttribute("h", &h) != TIXML_SUCCESS ||
+			el->QueryIntAttribute("tex", &tex) != TIXML_SUCCESS ||
+			tex < 0 || static_cast<size_t>(tex) >= sheet_sizes.size())
+			return false;
+
+		el->QueryIntAttribute("rotated", &rotated);
+
+		// aliases of a deduplicated sprite share its rectangle
+
+		if (!positions.insert((static_cast<uint64_t>(tex) << 48) | (static_cast<uint64_t>(x) << 24) | y).second)
+			continue;
+
+		const rect rc = rotated ? rect { x, y, h, w } : rect { x, y, w, h };
+		old_rects.push_back({ static_cast<size_t>(tex), rc, rotated != 0, static_cast<size_t>(w), static_cast<size_t>(h), nullptr });
+
+		old_hashes.emplace(strtoull(hash, nullptr, 16), old_rects.size() - 1);
+	}
+
+	// keep what's still there, in the old order so that an unchanged sheet
+	// is also written out the same
+
+	std::vector<const sprite_base *> new_sprites;
+
+	for (auto sp : sprites) {
+		auto range = old_hashes.equal_range(sp->hash_);
+
+		auto it = std::find_if(
+				range.first,
+				range.second,
+				[&](const std::pair<const uint64_t, size_t>& v)
+				{
+					const auto& r = old_rects[v.second];
+					return !r.sprite_ && r.width_ == sp->width() && r.height_ == sp->height();
+				});
+
+		if (it != range.second)
+			old_rects[it->second].sprite_ = sp;
+		else
+			new_sprites.push_back(sp);
+	}
+
+	auto type = options.packer;
+
+	if (type != packer_type::maxrects_bssf && type != packer_type::maxrects_baf &&
+		type != packer_type::maxrects_bl && type != packer_type::maxrects_cp)
+		type = packer_type::maxrects_bssf;
+
+	std::vector<std::unique_ptr<packer>> packers;
+
+	for (const auto& size : sheet_sizes)
+		packers.push_back(make_packer(type, size.first, size.second, options.allow_rotation));
+
+	// a sheet changes if a sprite was taken off it or put on it
+
+	unchanged.assign(packers.size(), true);
+
+	for (const auto& r : old_rects) {
+		if (r.sprite_)
+			packers[r.tex_]->reserve({ r.sprite_, r.rc_, r.rotated_ }, options.border);
+		else
+			unchanged[r.tex_] = false;
+	}
+
+	sort_sprites(new_sprites, options.sort);
+
+	std::vector<const sprite_base *> remaining_sprites;
+
+	for (auto sp : new_sprites) {
+		size_t i = 0;
+
+		while (i < packers.size() && !packers[i]->insert(sp, options.border))
+			++i;
+
+		if (i < packers.size())
+			unchanged[i] = false;
+		else
+			remaining_sprites.push_back(sp);
+	}
+
+	sheets.clear();
+
+	for (size_t i = 0; i < packers.size(); i++)
+		sheets.push_back({ static_cast<int>(sheet_sizes[i].first), static_cast<int>(sheet_sizes[i].second), packers[i]->sprite_rects() });
+
+	// sheets left empty at the end are dropped
+
+	while (!sheets.empty() && sheets.back().sprite_rects_.empty()) {
+		sheets.pop_back();
+		unchanged.pop_back();
+	}
+
+	if (!remaining_sprites.empty()) {
+		for (auto& s : pack_all(remaining_sprites, options)) {
+			sheets.push_back(std::move(s));
+			unchanged.push_back(false);
+		}
+	}
+
+	return true;
+}
+
+// a sprite overlapping the rows being composed, decoded and rotated as placed
+
+struct placed_image
+{
+	placed_image(const sprite_rect *p)
+	: rect_ { p }
+	{
+		const auto& im = p->sprite_->get_image(temp_);
+
+		if (p->rotated_)
+			temp_.reset(new image<uint32_t>(im.rotated()));
+
+		image_ = temp_ ? temp_.get() : &im;
+	}
+
+	int bottom() const
+	{ return rect_->rc_.top_ + image_->height; }
+
+	const sprite_rect *rect_;
+	std::unique_ptr<image<uint32_t>> temp_;
+	const image<uint32_t> *image_;
+};
+
+// the sheet is composed one band of rows at a time as the PNG is written,
+// touching only the sprites that overlap the band
+
 void
-write_sprite_sheet(const std::string& name, const node *root)
+write_sprite_sheet(const std::string& name, const sheet& s, const png_options& options)
 {
-	assert(root->rc_.top_ == 0 && root->rc_.left_ == 0);
+	std::vector<const sprite_rect *> by_top;
+
+	for (const auto& p : s.sprite_rects_)
+		by_top.push_back(&p);
+
+	std::stable_sort(
+		std::begin(by_top),
+		std::end(by_top),
+		[](const sprite_rect *a, const sprite_rect *b)
+		{
+			return a->rc_.top_ < b->rc_.top_;
+		});
 
-	image<uint32_t> im(root->rc_.width_, root->rc_.height_);
-	write_sprite_sheet(im, root);
-	png_write(im, name);
+	auto next = std::begin(by_top);
+	std::vector<placed_image> active;
+
+	png_write(
+		s.width_, s.height_,
+		[&](size_t first_row, image<uint32_t>& band)
+		{
+			const int top = first_row;
+			const int bottom = top + band.height;
+
+			active.erase(
+				std::remove_if(
+					std::begin(active),
+					std::end(active),
+					[=](const placed_image& p) { return p.bottom() <= top; }),
+				std::end(active));
+
+			for (; next != std::end(by_top) && (*next)->rc_.top_ < bottom; ++next)
+				active.emplace_back(*next);
+
+			for (const auto& p : active)
+				band.copy(*p.image_, p.rect_->rc_.top_ - top, p.rect_->rc_.left_);
+		},
+		name, options);
 }
 
 } // (anonymous namespace)
 
+pack_options::pack_options()
+: sheet_width { 256 }
+, sheet_height { 256 }
+, border { 2 }
+, packer { packer_type::tree }
+, sort { sort_order::area }
+, fill { sheet_fill::sequential }
+, try_all { false }
+, allow_rotation { false }
+, dedupe { false }
+, auto_size { false }
+, power_of_two { false }
+, square { false }
+, shrink_last { false }
+, incremental { false }
+, write_binary { false }
+, write_header { false }
+, num_threads { 0 }
+, texture_path_base { "." }
+{ }
+
+void
+parse_auto_size(const char *mode, pack_options& options)
+{
+	static const struct {
+		const char *name;
+		bool power_of_two;
+		bool square;
+	} modes[] = {
+		{ "any", false, false },
+		{ "pot", true, false },
+		{ "square", false, true },
+		{ "square-pot", true, true },
+	};
+
+	for (const auto& m : modes) {
+		if (!strcmp(m.name, mode)) {
+			options.auto_size = true;
+			options.power_of_two = m.power_of_two;
+			options.square = m.square;
+			return;
+		}
+	}
+
+	panic("unknown sheet size mode: %s", mode);
+}
+
+sort_order
+parse_sort_order(const char *name)
+{
+	static const struct {
+		const char *name;
+		sort_order order;
+	} sort_orders[] = {
+		{ "area", sort_order::area },
+		{ "max-side", sort_order::max_side },
+		{ "perimeter", sort_order::perimeter },
+		{ "height", sort_order::height },
+		{ "width", sort_order::width },
+	};
+
+	for (const auto& p : sort_orders) {
+		if (!strcmp(p.name, name))
+			return p.order;
+	}
+
+	panic("unknown sort order: %s", name);
+	return sort_order::area;
+}
+
+sheet_fill
+parse_sheet_fill(const char *name)
+{
+	static const struct {
+		const char *name;
+		sheet_fill fill;
+	} fills[] = {
+		{ "sequential", sheet_fill::sequential },
+		{ "first-fit", sheet_fill::first_fit },
+		{ "best-fit", sheet_fill::best_fit },
+	};
+
+	for (const auto& p : fills) {
+		if (!strcmp(p.name, name))
+			return p.fill;
+	}
+
+	panic("unknown sheet fill: %s", name);
+	return sheet_fill::sequential;
+}
+
 void
 pack(const std::vector<std::unique_ptr<sprite_base>>& sprites,
 		const std::string& sheet_name,
-		int sheet_width, int sheet_height,
-		int border,
-		const std::string& texture_path_base)
+		const pack_options& options,
+		const std::vector<kerning_pair>& kerning)
 {
 	// pack
 
 	std::vector<const sprite_base *> sorted_sprites;
 	sorted_sprites.reserve(sprites.size());
 
-	std::transform(
-		std::begin(sprites),
-		std::end(sprites),
-		std::back_inserter(sorted_sprites),
-		[](const std::unique_ptr<sprite_base>& p) { return p.get(); });
+	// sprites with the same image as an earlier one aren't packed, they're
+	// written out with the rectangle of the first one
 
-	std::vector<std::unique_ptr<node>> trees;
+	std::unordered_map<const sprite_base *, std::vector<const sprite_base *>> aliases;
 
-	while (!sorted_sprites.empty()) {
-		std::sort(
-			std::begin(sorted_sprites),
-			std::end(sorted_sprites),
-			[](const sprite_base *a, const sprite_base *b)
-			{
-				return b->width()*b->height() < a->width()*a->height();
-			});
+	// the sprite each one found by dedupe is written with
+	std::unordered_map<const sprite_base *, const sprite_base *> written_with;
+
+	if (options.dedupe) {
+		std::unordered_multimap<uint64_t, const sprite_base *> unique_sprites;
 
-		auto tree = new node { rect { 0, 0, sheet_width, sheet_height } };
+		for (const auto& p : sprites) {
+			if (p->alias_of_)
+				continue;
 
-		auto it = std::begin(sorted_sprites);
+			auto range = unique_sprites.equal_range(p->hash_);
 
-		while (it != std::end(sorted_sprites)) {
-			if (tree->insert(*it, border))
-				it = sorted_sprites.erase(it);
-			else
-				++it;
+			auto it = std::find_if(
+					range.first,
+					range.second,
+					[&](const std::pair<const uint64_t, const sprite_base *>& v)
+					{
+						return v.second->same_image(*p);
+					});
+
+			if (it != range.second) {
+				aliases[it->second].push_back(p.get());
+				written_with[p.get()] = it->second;
+			} else {
+				unique_sprites.emplace(p->hash_, p.get());
+				sorted_sprites.push_back(p.get());
+			}
+		}
+	} else {
+		for (const auto& p : sprites) {
+			if (!p->alias_of_)
+				sorted_sprites.push_back(p.get());
 		}
+	}
+
+	// sprites that were known to be the same from the start
 
-		trees.emplace_back(tree);
+	for (const auto& p : sprites) {
+		if (const sprite_base *target = p->alias_of_) {
+			auto it = written_with.find(target);
+			aliases[it != written_with.end() ? it->second : target].push_back(p.get());
+		}
 	}
 
-	auto texture_name = [&](size_t i)
-		{
-			std::stringstream ss;
-			ss << sheet_name << "." << i << ".png";
-			return ss.str();
-		};
+	std::vector<sheet> sheets;
+
+	// sheets whose texture from the previous run can be kept as is
+	std::vector<bool> unchanged;
+
+	if (!options.incremental || !pack_incremental(sheet_name, sorted_sprites, options, sheets, unchanged)) {
+		sheets = pack_all(sorted_sprites, options);
+		unchanged.assign(sheets.size(), false);
+	}
 
 	// write textures
 
-	for (size_t i = 0; i < trees.size(); i++)
-		write_sprite_sheet(texture_name(i), trees[i].get());
+	std::vector<size_t> changed_sheets;
 
-	// write sprite sheets
+	for (size_t i = 0; i < sheets.size(); i++) {
+		if (!unchanged[i])
+			changed_sheets.push_back(i);
+	}
 
-	TiXmlDocument doc;
+	// sheets are encoded in parallel; threads left over compress bands of
+	// rows of the same sheet, if enabled
 
-	auto decl = new TiXmlDeclaration( "1.0", "", "" );
-	doc.LinkEndChild(decl);
+	auto png = options.png;
+	png.num_threads = std::max<int>(1, thread_count(options.num_threads)/std::max<size_t>(1, changed_sheets.size()));
 
-	auto spritesheet_node = new TiXmlElement("spritesheet");
-	doc.LinkEndChild(spritesheet_node);
+	parallel_for(changed_sheets.size(), options.num_threads, [&](size_t i)
+		{
+			const size_t index = changed_sheets[i];
+			write_sprite_sheet(texture_name(sheet_name, index), sheets[index], png);
+		});
 
-	auto textures_node = new TiXmlElement("textures");
+	// write sprite sheets, straight to the files
 
-	for (size_t i = 0; i < trees.size(); i++) {
-		auto el = new TiXmlElement("texture");
-		el->SetAttribute("path", texture_path_base + "/" + texture_name(i));
-		textures_node->LinkEndChild(el);
-	}
+	// sorted by size, left code and right code, for a binary search
+	auto sorted_kerning = kerning;
+
+	std::sort(
+		std::begin(sorted_kerning),
+		std::end(sorted_kerning),
+		[](const kerning_pair& a, const kerning_pair& b)
+		{
+			return std::tie(a.size, a.left, a.right) < std::tie(b.size, b.left, b.right);
+		});
 
-	spritesheet_node->LinkEndChild(textures_node);
+	std::vector<std::unique_ptr<sheet_writer>> writers;
 
-	auto sprites_node = new TiXmlElement("sprites");
+	writers.emplace_back(new xml_sheet_writer(sheet_name + ".spr"));
 
-	for (size_t i = 0; i < trees.size(); i++) {
-		std::function<void(node *)> serialize_sprites = [&](const node *root)
+	if (options.write_binary)
+		writers.emplace_back(new binary_sheet_writer(sheet_name + ".sprb"));
+
+	if (options.write_header) {
+		// the sheet name, without the directory, is the namespace
+		const auto slash = sheet_name.find_last_of('/');
+		const auto base_name = slash == std::string::npos ? sheet_name : sheet_name.substr(slash + 1);
+
+		writers.emplace_back(new header_sheet_writer(sheet_name + ".h", base_name));
+	}
+
+	for (auto& writer : writers) {
+		for (size_t i = 0; i < sheets.size(); i++)
+			writer->texture(options.texture_path_base + "/" + texture_name(sheet_name, i));
+
+		auto serialize_sprite = [&](const sprite_base *sp, const sprite_rect& p, size_t tex)
 			{
-				if (root->left_) {
-					serialize_sprites(root->left_.get());
-					assert(root->right_);
-					serialize_sprites(root->right_.get());
-				} else if (root->sprite_) {
-					auto& rc = root->rc_;
-					auto border = root->border_;
-					auto sp = root->sprite_;
-
-					auto *el = new TiXmlElement("sprite");
-
-					el->SetAttribute("x", rc.left_ + border);
-					el->SetAttribute("y", rc.top_ + border);
-					el->SetAttribute("w", sp->width());
-					el->SetAttribute("h", sp->height());
-					el->SetAttribute("tex", i);
-
-					sp->serialize(el);
-
-					sprites_node->LinkEndChild(el);
+				auto& rc = p.rc_;
+
+				writer->begin_sprite();
+
+				writer->attribute("x", rc.left_);
+				writer->attribute("y", rc.top_);
+				writer->attribute("w", sp->width());
+				writer->attribute("h", sp->height());
+				writer->attribute("tex", tex);
+
+				if (p.rotated_)
+					writer->attribute("rotated", 1);
+
+				if (options.incremental) {
+					char hash[17];
+					snprintf(hash, sizeof(hash), "%016" PRIx64, sp->hash_);
+					writer->attribute("hash", hash);
 				}
+
+				sp->serialize(*writer);
+
+				writer->end_sprite();
 			};
 
-		serialize_sprites(trees[i].get());
-	}
+		for (size_t i = 0; i < sheets.size(); i++) {
+			for (const auto& p : sheets[i].sprite_rects_) {
+				serialize_sprite(p.sprite_, p, i);
+
+				auto it = aliases.find(p.sprite_);
 
-	spritesheet_node->LinkEndChild(sprites_node);
+				if (it != aliases.end()) {
+					for (auto sp : it->second)
+						serialize_sprite(sp, p, i);
+				}
+			}
+		}
 
-	doc.SaveFile(std::string(sheet_name) + ".spr");
+		for (const auto& k : sorted_kerning)
+			writer->kerning(k.size, k.left, k.right, k.amount);
+
+		writer->finish();
+	}
 }
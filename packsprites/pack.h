@@ -2,11 +2,96 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
-class sprite_base;
+#include "packer.h"
+#include "png_util.h"
+
+struct sprite_base;
+
+// sprites are packed from the biggest to the smallest by this measure
+enum class sort_order
+{
+	area,
+	max_side,
+	perimeter,
+	height,
+	width,
+};
+
+// how sprites are distributed among sheets
+enum class sheet_fill
+{
+	sequential, // fill a sheet, then start the next one with the leftovers
+	first_fit, // keep all sheets open, use the first one the sprite fits in
+	best_fit, // keep all sheets open, use the fullest one the sprite fits in
+};
+
+struct pack_options
+{
+	pack_options();
+
+	int sheet_width, sheet_height;
+	int border;
+	packer_type packer;
+	sort_order sort;
+	sheet_fill fill;
+
+	// try every packer and sort order in parallel and keep the best layout
+	bool try_all;
+
+	// let the packer turn sprites 90 degrees clockwise
+	bool allow_rotation;
+
+	// pack identical images only once
+	bool dedupe;
+
+	// shrink sheets to the smallest size that holds the sprites in as few
+	// sheets as sheet_width x sheet_height does
+	bool auto_size;
+	bool power_of_two;
+	bool square;
+
+	// shrink the last sheet to the smallest size that holds its sprites
+	bool shrink_last;
+
+	// keep unchanged sprites where the previous run put them, and only
+	// write the textures that changed
+	bool incremental;
+
+	// also write the metadata in binary form, see sprite_binary.h
+	bool write_binary;
+
+	// also write a C++ header with the sprite sheet as constexpr tables,
+	// see sprite_header.h
+	bool write_header;
+
+	// 0 for one thread per core
+	int num_threads;
+
+	png_options png;
+
+	std::string texture_path_base;
+};
+
+// horizontal adjustment, in pixels, between two glyphs next to each other
+struct kerning_pair
+{
+	int size; // font size, 0 if there's only one
+	int left, right; // codes
+	int amount;
+};
+
+sort_order
+parse_sort_order(const char *name);
+
+sheet_fill
+parse_sheet_fill(const char *name);
+
+void
+parse_auto_size(const char *mode, pack_options& options);
 
 void pack(const std::vector<std::unique_ptr<sprite_base>>& sprites,
 		const std::string& sheet_name,
-		int sheet_width, int sheet_height,
-		int border,
-		const std::string& texture_path_base);
+		const pack_options& options,
+		const std::vector<kerning_pair>& kerning = std::vector<kerning_pair>());
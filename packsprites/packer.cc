@@ -0,0 +1,84 @@
+#include <cstring>
+
+#include "tree_packer.h"
+#include "maxrects_packer.h"
+#include "skyline_packer.h"
+#include "panic.h"
+#include "packer.h"
+
+namespace {
+
+const struct {
+	const char *name;
+	packer_type type;
+} packer_types[] = {
+	{ "tree", packer_type::tree },
+	{ "maxrects-bssf", packer_type::maxrects_bssf },
+	{ "maxrects-baf", packer_type::maxrects_baf },
+	{ "maxrects-bl", packer_type::maxrects_bl },
+	{ "maxrects-cp", packer_type::maxrects_cp },
+	{ "skyline", packer_type::skyline },
+};
+
+} // (anonymous namespace)
+
+packer::~packer() = default;
+
+void
+packer::reserve(const sprite_rect&, int)
+{
+	panic("packer can't keep sprites in place");
+}
+
+std::unique_ptr<packer>
+make_packer(packer_type type, int width, int height, bool allow_rotation)
+{
+	switch (type) {
+		case packer_type::tree:
+			return std::unique_ptr<packer> { new tree_packer { width, height, allow_rotation } };
+
+		case packer_type::maxrects_bssf:
+			return std::unique_ptr<packer> { new maxrects_packer { width, height, allow_rotation, maxrects_packer::heuristic::best_short_side_fit } };
+
+		case packer_type::maxrects_baf:
+			return std::unique_ptr<packer> { new maxrects_packer { width, height, allow_rotation, maxrects_packer::heuristic::best_area_fit } };
+
+		case packer_type::maxrects_bl:
+			return std::unique_ptr<packer> { new maxrects_packer { width, height, allow_rotation, maxrects_packer::heuristic::bottom_left } };
+
+		case packer_type::maxrects_cp:
+			return std::unique_ptr<packer> { new maxrects_packer { width, height, allow_rotation, maxrects_packer::heuristic::contact_point } };
+
+		case packer_type::skyline:
+			return std::unique_ptr<packer> { new skyline_packer { width, height, allow_rotation } };
+	}
+
+	panic("invalid packer type");
+	return nullptr;
+}
+
+packer_type
+parse_packer_type(const char *name)
+{
+	if (!strcmp(name, "maxrects"))
+		return packer_type::maxrects_bssf;
+
+	for (const auto& p : packer_types) {
+		if (!strcmp(p.name, name))
+			return p.type;
+	}
+
+	panic("unknown packer: %s", name);
+	return packer_type::tree;
+}
+
+std::vector<packer_type>
+all_packer_types()
+{
+	std::vector<packer_type> types;
+
+	for (const auto& p : packer_types)
+		types.push_back(p.type);
+
+	return types;
+}
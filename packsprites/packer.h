@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "rect.h"
+
+struct sprite_base;
+
+// where a sprite ended up on a sheet, not including the border; rotated
+// sprites are turned 90 degrees clockwise, so rc_ is height() x width()
+struct sprite_rect
+{
+	const sprite_base *sprite_;
+	rect rc_;
+	bool rotated_;
+};
+
+enum class packer_type
+{
+	tree,
+	maxrects_bssf,
+	maxrects_baf,
+	maxrects_bl,
+	maxrects_cp,
+	skyline,
+};
+
+class packer
+{
+public:
+	virtual ~packer();
+
+	virtual bool insert(const sprite_base *sp, int border) = 0;
+
+	// placed sprites, in the order they should be written out
+	virtual std::vector<sprite_rect> sprite_rects() const = 0;
+
+	// keeps a sprite where an earlier run placed it, before inserting any
+	// other; only packers that track arbitrary free space support this
+	virtual void reserve(const sprite_rect& p, int border);
+};
+
+std::unique_ptr<packer>
+make_packer(packer_type type, int width, int height, bool allow_rotation);
+
+packer_type
+parse_packer_type(const char *name);
+
+std::vector<packer_type>
+all_packer_types();
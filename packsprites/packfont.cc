@@ -12,9 +12,14 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "font.h"
+#include "glyph_cache.h"
 #include "pack.h"
+#include "parallel.h"
 #include "panic.h"
 
 namespace {
@@ -29,14 +34,35 @@ usage(const char *argv0)
 		"-b	size in pixels of border around the packed sprites (default: 2)\n"
 		"-w	spritesheet width (default: 256)\n"
 		"-h	spritesheet height (default: 256)\n"
-		"-s	font size (default: 16)\n"
+		"-a	shrink sheets to the smallest size that needs no more sheets than -w x -h:\n"
+		"	any, pot (power of two), square or square-pot\n"
+		"-p	packer: tree, maxrects-bssf, maxrects-baf, maxrects-bl, maxrects-cp or skyline (default: tree)\n"
+		"-O	sort order: area, max-side, perimeter, height or width (default: area)\n"
+		"-x	try every packer and sort order, keep the layout with the fewest sheets\n"
+		"-F	sheet fill: sequential, first-fit or best-fit (default: sequential)\n"
+		"-R	shrink the last sheet to the smallest size that holds its sprites\n"
+		"-I	incremental: keep unchanged sprites where the previous run put them\n"
+		"-M	also write the sprite sheet in binary form, for memory mapping (sheetname.sprb)\n"
+		"-H	also write the sprite sheet as a C++ header with constexpr tables (sheetname.h)\n"
+		"-r	allow sprites to be rotated 90 degrees clockwise\n"
+		"-u	pack identical sprites only once\n"
+		"-z	PNG compression level, 0 to 9, fast or max (default: 9)\n"
+		"-f	PNG filter: none, sub, up, average, paeth or adaptive (default: adaptive)\n"
+		"-Z	compress bands of rows of each texture in parallel\n"
+		"-j	number of threads (default: one per core)\n"
+		"-s	font size, or comma-separated sizes to pack together (default: 16)\n"
 		"-g	outline radius, in pixels (default: 2)\n"
 		"-i	font color\n"
 		"-o	outline color\n"
 		"-S	drop shadow opacity, between 0 and 1 (default: .2)\n"
 		"-B	drop shadow gaussian blur radius, in pixels (default: 0)\n"
 		"-d	drop shadow x offset, in pixels (default: 0)\n"
-		"-e	drop shadow y offset, in pixels (default: 0)\n");
+		"-e	drop shadow y offset, in pixels (default: 0)\n"
+		"-m	keep code points the font has no glyph for, drawn with its missing glyph\n"
+		"-k	write the kerning pairs of the glyphs\n"
+		"-c	keep rendered glyphs in the given directory and reuse them in later runs\n"
+		"-D	render signed distance fields that reach the given distance from the edge, in pixels,\n"
+		"	instead of the glyphs (colors, outline and shadow are ignored)\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -46,6 +72,30 @@ parse_int(const char *str)
 	return *str == 'x' || *str == 'X' ? strtol(str + 1, 0, 16) : strtol(str, 0, 10);
 }
 
+std::vector<int>
+parse_sizes(const char *str)
+{
+	std::vector<int> sizes;
+
+	for (;;) {
+		char *end;
+		const int size = strtol(str, &end, 10);
+
+		if (end == str || size <= 0)
+			panic("invalid font size: %s", str);
+
+		if (std::find(std::begin(sizes), std::end(sizes), size) == std::end(sizes))
+			sizes.push_back(size);
+
+		if (*end != ',')
+			break;
+
+		str = end + 1;
+	}
+
+	return sizes;
+}
+
 rgba<int>
 parse_color(const char *str)
 {
@@ -89,10 +139,8 @@ parse_color_fn(const char *str)
 int
 main(int argc, char *argv[])
 {
-	int border = 2;
-	int font_size = 16;
-	int sheet_width = 256;
-	int sheet_height = 256;
+	pack_options options;
+	std::vector<int> font_sizes { 16 };
 	int outline_radius = 2;
 	color_fn inner_color_fn { [](float) { return rgba<int> { 255, 255, 255, 255 }; } };
 	color_fn outer_color_fn { [](float) { return rgba<int> { 0, 0, 0, 255 }; } };
@@ -100,26 +148,91 @@ main(int argc, char *argv[])
 	int shadow_dy = 0;
 	float shadow_opacity = .2;
 	int shadow_blur_radius = 0;
-	std::string texture_path_base = ".";
+	int distance_field_spread = 0;
+	const char *inner_color = "";
+	const char *outer_color = "";
+	const char *cache_dir = nullptr;
+	bool keep_missing = false;
+	bool write_kerning = false;
 
 	int c;
 
-	while ((c = getopt(argc, argv, "b:s:w:h:g:t:i:o:S:d:e:B:")) != EOF) {
+	while ((c = getopt(argc, argv, "b:s:w:h:p:a:O:xF:RIMHruz:f:Zj:g:t:i:o:S:d:e:B:D:c:mk")) != EOF) {
 		switch (c) {
 			case 'b':
-				border = atoi(optarg);
+				options.border = atoi(optarg);
+				break;
+
+			case 'j':
+				options.num_threads = atoi(optarg);
 				break;
 
 			case 's':
-				font_size = atoi(optarg);
+				font_sizes = parse_sizes(optarg);
 				break;
 
 			case 'w':
-				sheet_width = atoi(optarg);
+				options.sheet_width = atoi(optarg);
 				break;
 
 			case 'h':
-				sheet_height = atoi(optarg);
+				options.sheet_height = atoi(optarg);
+				break;
+
+			case 'p':
+				options.packer = parse_packer_type(optarg);
+				break;
+
+			case 'a':
+				parse_auto_size(optarg, options);
+				break;
+
+			case 'O':
+				options.sort = parse_sort_order(optarg);
+				break;
+
+			case 'x':
+				options.try_all = true;
+				break;
+
+			case 'F':
+				options.fill = parse_sheet_fill(optarg);
+				break;
+
+			case 'R':
+				options.shrink_last = true;
+				break;
+
+			case 'I':
+				options.incremental = true;
+				break;
+
+			case 'M':
+				options.write_binary = true;
+				break;
+
+			case 'H':
+				options.write_header = true;
+				break;
+
+			case 'r':
+				options.allow_rotation = true;
+				break;
+
+			case 'u':
+				options.dedupe = true;
+				break;
+
+			case 'z':
+				parse_png_compression(optarg, options.png);
+				break;
+
+			case 'f':
+				options.png.filter = parse_png_filter(optarg);
+				break;
+
+			case 'Z':
+				options.png.parallel_bands = true;
 				break;
 
 			case 'g':
@@ -127,14 +240,16 @@ main(int argc, char *argv[])
 				break;
 
 			case 't':
-				texture_path_base = optarg;
+				options.texture_path_base = optarg;
 				break;
 
 			case 'i':
+				inner_color = optarg;
 				inner_color_fn = parse_color_fn(optarg);
 				break;
 
 			case 'o':
+				outer_color = optarg;
 				outer_color_fn = parse_color_fn(optarg);
 				break;
 
@@ -153,6 +268,22 @@ main(int argc, char *argv[])
 			case 'e':
 				shadow_dy = atoi(optarg);
 				break;
+
+			case 'D':
+				distance_field_spread = atoi(optarg);
+				break;
+
+			case 'c':
+				cache_dir = optarg;
+				break;
+
+			case 'm':
+				keep_missing = true;
+				break;
+
+			case 'k':
+				write_kerning = true;
+				break;
 		}
 	}
 
@@ -168,7 +299,7 @@ main(int argc, char *argv[])
 
 	f.set_outline_radius(outline_radius);
 
-	f.set_char_size(font_size);
+	f.set_char_size(font_sizes.front());
 
 	f.set_inner_color_fn(inner_color_fn);
 	f.set_outer_color_fn(outer_color_fn);
@@ -177,6 +308,21 @@ main(int argc, char *argv[])
 	f.set_shadow_opacity(shadow_opacity);
 	f.set_shadow_blur_radius(shadow_blur_radius);
 
+	f.set_distance_field(distance_field_spread);
+
+	// code points the font has no glyph for are dropped, unless asked to
+	// keep them; code points for the same glyph are rendered once and
+	// share its rectangle
+
+	std::vector<wchar_t> codes;
+	std::vector<FT_UInt> indices;
+
+	// other code points, with the index in codes of their glyph
+	std::vector<std::pair<wchar_t, size_t>> alias_codes;
+
+	std::unordered_map<FT_UInt, size_t> glyph_indices;
+	std::unordered_set<wchar_t> seen_codes;
+
 	for (int i = optind + 2; i < argc; i++) {
 		char *range = argv[i];
 
@@ -189,13 +335,138 @@ main(int argc, char *argv[])
 			to = from;
 		}
 
-		for (int j = from; j <= to; j++)
-			sprites.push_back(f.render_glyph(j));
+		for (int j = from; j <= to; j++) {
+			const FT_UInt index = f.glyph_index(j);
+
+			if ((index == 0 && !keep_missing) || !seen_codes.insert(j).second)
+				continue;
+
+			auto it = glyph_indices.find(index);
+
+			if (it != glyph_indices.end()) {
+				alias_codes.emplace_back(j, it->second);
+			} else {
+				glyph_indices[index] = codes.size();
+				codes.push_back(j);
+				indices.push_back(index);
+			}
+		}
+	}
+
+	// everything but the size and code point that the glyph images
+	// depend on
+
+	std::unique_ptr<glyph_cache> cache;
+
+	if (cache_dir) {
+		std::stringstream settings;
+		settings
+			<< outline_radius << ' '
+			<< inner_color << ' '
+			<< outer_color << ' '
+			<< shadow_dx << ' '
+			<< shadow_dy << ' '
+			<< shadow_opacity << ' '
+			<< shadow_blur_radius << ' '
+			<< distance_field_spread;
+
+		cache.reset(new glyph_cache(cache_dir, font_name, settings.str()));
+	}
+
+	// every glyph is rendered at every size, all packed together; glyphs
+	// only get a size attribute if there's more than one
+
+	const size_t num_glyphs = codes.size();
+	const size_t num_tasks = font_sizes.size()*num_glyphs;
+
+	auto glyph_size = [&](size_t task) { return font_sizes.size() > 1 ? font_sizes[task/num_glyphs] : 0; };
+
+	// each thread renders with its own copy of the font, switching sizes
+	// as needed; glyphs keep the order of the sizes and code points
+
+	std::vector<std::unique_ptr<font>> fonts;
+
+	for (int i = 1; i < worker_count(num_tasks, options.num_threads); i++)
+		fonts.emplace_back(new font(f));
+
+	auto worker_font = [&](int worker, size_t task) -> font&
+		{
+			auto& wf = worker == 0 ? f : *fonts[worker - 1];
+
+			const int size = font_sizes[task/num_glyphs];
+
+			if (wf.char_size() != size)
+				wf.set_char_size(size);
+
+			return wf;
+		};
+
+	std::vector<std::unique_ptr<glyph>> glyphs(num_tasks);
+
+	parallel_for_workers(num_tasks, options.num_threads, [&](size_t task, int worker)
+		{
+			const wchar_t code = codes[task % num_glyphs];
+			const int size = font_sizes[task/num_glyphs];
+
+			auto& g = glyphs[task];
+
+			if (cache)
+				g = cache->get(code, size);
+
+			if (!g) {
+				g = worker_font(worker, task).render_glyph(code);
+
+				if (cache)
+					cache->put(*g, size);
+			}
+
+			g->size_ = glyph_size(task);
+		});
+
+	for (size_t i = 0; i < font_sizes.size(); i++) {
+		for (const auto& p : alias_codes)
+			glyphs.emplace_back(new glyph(p.first, glyphs[i*num_glyphs + p.second].get()));
+	}
+
+	for (auto& g : glyphs)
+		sprites.emplace_back(std::move(g));
+
+	// kerning of every pair of glyphs at every size, for all the code
+	// points of each
+
+	std::vector<kerning_pair> kerning;
+
+	if (write_kerning && f.has_kerning()) {
+		std::vector<std::vector<wchar_t>> glyph_codes(num_glyphs);
+
+		for (size_t i = 0; i < num_glyphs; i++)
+			glyph_codes[i].push_back(codes[i]);
+
+		for (const auto& p : alias_codes)
+			glyph_codes[p.second].push_back(p.first);
+
+		std::vector<std::vector<kerning_pair>> rows(num_tasks);
+
+		parallel_for_workers(num_tasks, options.num_threads, [&](size_t task, int worker)
+			{
+				auto& wf = worker_font(worker, task);
+
+				const size_t i = task % num_glyphs;
+				const int size = glyph_size(task);
+
+				for (size_t j = 0; j < num_glyphs; j++) {
+					if (int amount = wf.kerning(indices[i], indices[j])) {
+						for (auto left : glyph_codes[i]) {
+							for (auto right : glyph_codes[j])
+								rows[task].push_back(kerning_pair { size, left, right, amount });
+						}
+					}
+				}
+			});
+
+		for (const auto& row : rows)
+			kerning.insert(std::end(kerning), std::begin(row), std::end(row));
 	}
 
-	pack(sprites,
-		sheet_name,
-		sheet_width, sheet_height,
-		border,
-		texture_path_base.c_str());
+	pack(sprites, sheet_name, options, kerning);
 }
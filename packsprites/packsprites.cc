@@ -8,10 +8,13 @@
 #include <sys/types.h>
 
 #include <vector>
+#include <string>
+#include <unordered_map>
 
 #include "sprite.h"
 #include "pack.h"
 #include "png_util.h"
+#include "parallel.h"
 #include "panic.h"
 
 static void
@@ -23,7 +26,25 @@ usage(const char *argv0)
 		"options:\n"
 		"-b	size of border around the packed sprites, in pixels (default: 2)\n"
 		"-w	spritesheet width (default: 256)\n"
-		"-h	spritesheet height (default: 256)\n");
+		"-h	spritesheet height (default: 256)\n"
+		"-a	shrink sheets to the smallest size that needs no more sheets than -w x -h:\n"
+		"	any, pot (power of two), square or square-pot\n"
+		"-p	packer: tree, maxrects-bssf, maxrects-baf, maxrects-bl, maxrects-cp or skyline (default: tree)\n"
+		"-O	sort order: area, max-side, perimeter, height or width (default: area)\n"
+		"-x	try every packer and sort order, keep the layout with the fewest sheets\n"
+		"-F	sheet fill: sequential, first-fit or best-fit (default: sequential)\n"
+		"-R	shrink the last sheet to the smallest size that holds its sprites\n"
+		"-I	incremental: keep unchanged sprites where the previous run put them\n"
+		"-M	also write the sprite sheet in binary form, for memory mapping (sheetname.sprb)\n"
+		"-H	also write the sprite sheet as a C++ header with constexpr tables (sheetname.h)\n"
+		"-r	allow sprites to be rotated 90 degrees clockwise\n"
+		"-u	pack identical sprites only once\n"
+		"-z	PNG compression level, 0 to 9, fast or max (default: 9)\n"
+		"-f	PNG filter: none, sub, up, average, paeth or adaptive (default: adaptive)\n"
+		"-Z	compress bands of rows of each texture in parallel\n"
+		"-T	trim fully transparent margins of the sprites\n"
+		"-L	don't keep sprite images in memory, decode them again when writing the textures\n"
+		"-j	number of threads (default: one per core)\n");
 
 	exit(EXIT_FAILURE);
 }
@@ -32,34 +53,108 @@ int
 main(int argc, char *argv[])
 {
 	int c;
-	int border = 2;
-	int sheet_width = 256;
-	int sheet_height = 256;
-	std::string texture_path_base = ".";
+	pack_options options;
+	bool trim = false;
+	bool lazy = false;
 
-	while ((c = getopt(argc, argv, "b:w:h:t:")) != EOF) {
+	while ((c = getopt(argc, argv, "b:w:h:t:p:a:O:xF:RIMHruz:f:ZTLj:")) != EOF) {
 		switch (c) {
 			case 'b':
-				border = atoi(optarg);
+				options.border = atoi(optarg);
 				break;
 
 			case 'w':
-				sheet_width = atoi(optarg);
+				options.sheet_width = atoi(optarg);
 				break;
 
 			case 'h':
-				sheet_height = atoi(optarg);
+				options.sheet_height = atoi(optarg);
 				break;
 
 			case 't':
-				texture_path_base = optarg;
+				options.texture_path_base = optarg;
+				break;
+
+			case 'p':
+				options.packer = parse_packer_type(optarg);
+				break;
+
+			case 'a':
+				parse_auto_size(optarg, options);
+				break;
+
+			case 'O':
+				options.sort = parse_sort_order(optarg);
+				break;
+
+			case 'x':
+				options.try_all = true;
+				break;
+
+			case 'F':
+				options.fill = parse_sheet_fill(optarg);
+				break;
+
+			case 'R':
+				options.shrink_last = true;
+				break;
+
+			case 'I':
+				options.incremental = true;
+				break;
+
+			case 'M':
+				options.write_binary = true;
+				break;
+
+			case 'H':
+				options.write_header = true;
+				break;
+
+			case 'r':
+				options.allow_rotation = true;
+				break;
+
+			case 'u':
+				options.dedupe = true;
+				break;
+
+			case 'z':
+				parse_png_compression(optarg, options.png);
+				break;
+
+			case 'f':
+				options.png.filter = parse_png_filter(optarg);
+				break;
+
+			case 'Z':
+				options.png.parallel_bands = true;
+				break;
+
+			case 'T':
+				trim = true;
+				break;
+
+			case 'L':
+				lazy = true;
+				break;
+
+			case 'j':
+				options.num_threads = atoi(optarg);
 				break;
 		}
 	}
 
 	const char *sheet_name = argv[optind];
 
-	std::vector<std::unique_ptr<sprite_base>> sprites;
+	// list the sprites first, then decode them in parallel
+
+	struct sprite_file
+	{
+		std::string name, path;
+	};
+
+	std::vector<sprite_file> files;
 
 	for (int i = optind + 1; i < argc; i++) {
 		const char *dir_name = argv[i];
@@ -72,19 +167,91 @@ main(int argc, char *argv[])
 			const char *name = de->d_name;
 			size_t len = strlen(name);
 
-			if (len >= 4 && !strcmp(name + len - 4, ".png")) {
-				char path[PATH_MAX];
-				sprintf(path, "%s/%s", dir_name, name);
-				sprites.push_back(std::unique_ptr<sprite_base> { new sprite(name, png_read(path)) });
-			}
+			if (len >= 4 && !strcmp(name + len - 4, ".png"))
+				files.push_back({ name, std::string(dir_name) + "/" + name });
 		}
 
 		closedir(dir);
 	}
 
-	pack(sprites,
-		sheet_name,
-		sheet_width, sheet_height,
-		border,
-		texture_path_base.c_str());
+	std::vector<std::unique_ptr<sprite_base>> sprites(files.size());
+
+	parallel_for(files.size(), options.num_threads, [&](size_t i)
+		{
+			const auto& f = files[i];
+
+			std::unique_ptr<sprite> sp;
+
+			if (lazy && !trim && !options.dedupe && !options.incremental) {
+				// the size is all the packer needs
+
+				size_t width, height;
+				png_read_size(f.path, width, height);
+				sp.reset(new sprite(f.name, f.path, width, height));
+			} else {
+				sp.reset(new sprite(f.name, f.path, png_read(f.path)));
+
+				if (trim)
+					sp->trim();
+
+				// trimming, deduplication and incremental packing need the pixels, but only once
+
+				if (lazy)
+					sp->unload();
+			}
+
+			sprites[i] = std::move(sp);
+		});
+
+	// with the images dropped, deduplication would decode both sprites of
+	// every pair with the same hash again, one pair at a time. instead,
+	// each sprite whose hash isn't unique is decoded once here, in
+	// parallel, and the ones with the same pixels as an earlier sprite
+	// become its aliases
+
+	if (lazy && options.dedupe) {
+		std::unordered_map<uint64_t, size_t> group_index;
+		std::vector<std::vector<sprite_base *>> groups;
+
+		for (const auto& p : sprites) {
+			auto it = group_index.insert({ p->hash_, groups.size() }).first;
+
+			if (it->second == groups.size())
+				groups.emplace_back();
+
+			groups[it->second].push_back(p.get());
+		}
+
+		parallel_for(groups.size(), options.num_threads, [&](size_t i)
+			{
+				const auto& group = groups[i];
+
+				if (group.size() < 2)
+					return;
+
+				// the first sprite with each image, and that image
+				std::vector<std::pair<sprite_base *, std::unique_ptr<image<uint32_t>>>> firsts;
+
+				for (auto sp : group) {
+					auto im = sp->load_image();
+
+					auto it = std::find_if(
+							std::begin(firsts),
+							std::end(firsts),
+							[&](const std::pair<sprite_base *, std::unique_ptr<image<uint32_t>>>& v)
+							{
+								return v.second->width == im->width &&
+									v.second->height == im->height &&
+									v.second->pixels == im->pixels;
+							});
+
+					if (it != std::end(firsts))
+						sp->alias_of_ = it->first;
+					else
+						firsts.emplace_back(sp, std::move(im));
+				}
+			});
+	}
+
+	pack(sprites, sheet_name, options);
 }
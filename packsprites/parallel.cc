@@ -0,0 +1,58 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "parallel.h"
+
+int
+thread_count(int num_threads)
+{
+	if (num_threads > 0)
+		return num_threads;
+
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+int
+worker_count(size_t count, int num_threads)
+{
+	return std::min<size_t>(thread_count(num_threads), count);
+}
+
+void
+parallel_for(size_t count, int num_threads, const std::function<void(size_t)>& fn)
+{
+	parallel_for_workers(count, num_threads, [&](size_t i, int) { fn(i); });
+}
+
+void
+parallel_for_workers(size_t count, int num_threads, const std::function<void(size_t, int)>& fn)
+{
+	const int workers = worker_count(count, num_threads);
+
+	if (workers <= 1) {
+		for (size_t i = 0; i < count; i++)
+			fn(i, 0);
+		return;
+	}
+
+	std::atomic<size_t> next { 0 };
+
+	auto worker = [&](int index)
+		{
+			size_t i;
+			while ((i = next++) < count)
+				fn(i, index);
+		};
+
+	std::vector<std::thread> threads;
+
+	for (int i = 1; i < workers; i++)
+		threads.emplace_back(worker, i);
+
+	worker(0);
+
+	for (auto& t : threads)
+		t.join();
+}
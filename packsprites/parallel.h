@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// number of worker threads to use when asked for num_threads; 0 means one
+// per core
+int
+thread_count(int num_threads);
+
+// number of threads parallel_for will actually use
+int
+worker_count(size_t count, int num_threads);
+
+// calls fn(i) for every i in [0, count), spread over up to num_threads threads
+void
+parallel_for(size_t count, int num_threads, const std::function<void(size_t)>& fn);
+
+// same, but also passes the index of the calling thread, in
+// [0, worker_count(count, num_threads)), for per-thread state
+void
+parallel_for_workers(size_t count, int num_threads, const std::function<void(size_t, int)>& fn);
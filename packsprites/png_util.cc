@@ -1,7 +1,13 @@
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
 
 #include <png.h>
+#include <zlib.h>
 
+#include "parallel.h"
 #include "panic.h"
 #include "png_util.h"
 
@@ -28,9 +34,335 @@ struct file {
 #define png_jmpbuf(png_ptr) ((png_ptr)->jmpbuf)
 #endif
 
+namespace {
+
+// rows per band requested from the band filler, and per independently
+// compressed band in parallel_bands mode; fixed so the output doesn't
+// depend on the number of threads
+const size_t band_rows = 256;
+
+const size_t zlib_window_size = 32768;
+
+int
+libpng_filter(png_filter filter)
+{
+	switch (filter) {
+		case png_filter::none:
+			return PNG_FILTER_NONE;
+
+		case png_filter::sub:
+			return PNG_FILTER_SUB;
+
+		case png_filter::up:
+			return PNG_FILTER_UP;
+
+		case png_filter::average:
+			return PNG_FILTER_AVG;
+
+		case png_filter::paeth:
+			return PNG_FILTER_PAETH;
+
+		case png_filter::adaptive:
+		default:
+			return PNG_ALL_FILTERS;
+	}
+}
+
+void
+pack_row(const rgba_image& im, size_t i, png_byte *dest)
+{
+	for (size_t j = 0; j < im.width; j++) {
+		rgba<int> c { im(i, j) };
+		*dest++ = c.r;
+		*dest++ = c.g;
+		*dest++ = c.b;
+		*dest++ = c.a;
+	}
+}
+
+png_byte
+paeth_predictor(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = std::abs(p - a);
+	const int pb = std::abs(p - b);
+	const int pc = std::abs(p - c);
+
+	if (pa <= pb && pa <= pc)
+		return a;
+	else if (pb <= pc)
+		return b;
+	else
+		return c;
+}
+
+// filters a row of RGBA pixels; prev is all zeros for the first row
+
+void
+filter_row(png_filter filter, const png_byte *row, const png_byte *prev, size_t size, png_byte *dest)
+{
+	const size_t bpp = 4;
+
+	dest[0] = static_cast<png_byte>(filter);
+	++dest;
+
+	for (size_t i = 0; i < size; i++) {
+		const int a = i >= bpp ? row[i - bpp] : 0;
+		const int b = prev[i];
+		const int c = i >= bpp ? prev[i - bpp] : 0;
+
+		png_byte predicted;
+
+		switch (filter) {
+			case png_filter::sub:
+				predicted = a;
+				break;
+
+			case png_filter::up:
+				predicted = b;
+				break;
+
+			case png_filter::average:
+				predicted = (a + b)/2;
+				break;
+
+			case png_filter::paeth:
+				predicted = paeth_predictor(a, b, c);
+				break;
+
+			default:
+				predicted = 0;
+				break;
+		}
+
+		dest[i] = row[i] - predicted;
+	}
+}
+
+// picks the filter with the smallest sum of absolute values, as libpng does
+
+void
+filter_row_adaptive(const png_byte *row, const png_byte *prev, size_t size, png_byte *dest, std::vector<png_byte>& temp)
+{
+	static const png_filter filters[] = {
+		png_filter::none,
+		png_filter::sub,
+		png_filter::up,
+		png_filter::average,
+		png_filter::paeth,
+	};
+
+	temp.resize(size + 1);
+
+	long best_sum = -1;
+
+	for (auto filter : filters) {
+		filter_row(filter, row, prev, size, &temp[0]);
+
+		long sum = 0;
+
+		for (size_t i = 1; i <= size; i++)
+			sum += std::abs(static_cast<signed char>(temp[i]));
+
+		if (best_sum < 0 || sum < best_sum) {
+			best_sum = sum;
+			std::copy(std::begin(temp), std::end(temp), dest);
+		}
+	}
+}
+
+void
+write_chunk(FILE *s, const char *type, const png_byte *data, size_t size)
+{
+	png_byte header[8];
+	png_save_uint_32(header, size);
+	memcpy(header + 4, type, 4);
+
+	uLong crc = crc32(0, header + 4, 4);
+
+	if (size)
+		crc = crc32(crc, data, size);
+
+	png_byte trailer[4];
+	png_save_uint_32(trailer, crc);
+
+	if (fwrite(header, 1, sizeof(header), s) != sizeof(header) ||
+		(size && fwrite(data, 1, size, s) != size) ||
+		fwrite(trailer, 1, sizeof(trailer), s) != sizeof(trailer))
+		panic("write failed: %s", strerror(errno));
+}
+
+// writes the PNG without libpng: each band of rows is filtered and deflated
+// on its own thread, primed with the last 32K of the previous band as
+// dictionary, and flushed to a byte boundary, so that the raw deflate
+// streams can be simply concatenated; the adler32 checksums of the bands
+// are combined for the zlib trailer. the image is requested from fill_band
+// one band per thread at a time
+
+void
+png_write_bands(size_t width, size_t height, const png_band_filler& fill_band, const std::string& path, const png_options& options)
+{
+	const size_t row_size = 4*width;
+	const size_t filtered_row_size = row_size + 1;
+	const size_t fill_rows = band_rows*thread_count(options.num_threads);
+
+	file f { path, "wb" };
+
+	static const png_byte signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+	if (fwrite(signature, 1, sizeof(signature), f.s) != sizeof(signature))
+		panic("write failed: %s", strerror(errno));
+
+	png_byte ihdr[13];
+	png_save_uint_32(ihdr, width);
+	png_save_uint_32(ihdr + 4, height);
+	ihdr[8] = 8; // bit depth
+	ihdr[9] = PNG_COLOR_TYPE_RGBA;
+	ihdr[10] = PNG_COMPRESSION_TYPE_DEFAULT;
+	ihdr[11] = PNG_FILTER_TYPE_DEFAULT;
+	ihdr[12] = PNG_INTERLACE_NONE;
+	write_chunk(f.s, "IHDR", ihdr, sizeof(ihdr));
+
+	// zlib header, then the concatenated deflate streams
+
+	const int level = options.compression_level;
+	const int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+	const int cmf = 0x78;
+	int flg = flevel << 6;
+	flg += 31 - (cmf*256 + flg) % 31;
+
+	const png_byte zlib_header[2] = { static_cast<png_byte>(cmf), static_cast<png_byte>(flg) };
+	write_chunk(f.s, "IDAT", zlib_header, sizeof(zlib_header));
+
+	// last row of the previous rows requested, for the filters
+	std::vector<png_byte> last_row(row_size);
+
+	// the filtered rows requested, after the last 32K of the previous ones
+	std::vector<png_byte> filtered;
+	size_t history_size = 0;
+
+	uLong checksum = adler32(0, nullptr, 0);
+
+	for (size_t first_row = 0; first_row < height; first_row += fill_rows) {
+		rgba_image im(width, std::min(fill_rows, height - first_row));
+		fill_band(first_row, im);
+
+		const size_t num_bands = (im.height + band_rows - 1)/band_rows;
+		const bool last_fill = first_row + im.height == height;
+
+		filtered.resize(history_size + im.height*filtered_row_size);
+
+		parallel_for(num_bands, options.num_threads, [&](size_t band)
+			{
+				const size_t first = band*band_rows;
+				const size_t last = std::min(first + band_rows, im.height);
+
+				std::vector<png_byte> prev(last_row), row(row_size), temp;
+
+				if (first > 0)
+					pack_row(im, first - 1, &prev[0]);
+
+				for (size_t i = first; i < last; i++) {
+					pack_row(im, i, &row[0]);
+
+					auto dest = &filtered[history_size + i*filtered_row_size];
+
+					if (options.filter == png_filter::adaptive)
+						filter_row_adaptive(&row[0], &prev[0], row_size, dest, temp);
+					else
+						filter_row(options.filter, &row[0], &prev[0], row_size, dest);
+
+					row.swap(prev);
+				}
+			});
+
+		std::vector<std::vector<png_byte>> compressed(num_bands);
+		std::vector<uLong> checksums(num_bands);
+
+		parallel_for(num_bands, options.num_threads, [&](size_t band)
+			{
+				const size_t begin = history_size + band*band_rows*filtered_row_size;
+				const size_t end = history_size + std::min((band + 1)*band_rows, im.height)*filtered_row_size;
+				const bool last = last_fill && band == num_bands - 1;
+
+				z_stream z;
+				memset(&z, 0, sizeof z);
+
+				if (deflateInit2(&z, options.compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+					panic("deflateInit2 failed");
+
+				if (begin > 0) {
+					const size_t dict_size = std::min(begin, zlib_window_size);
+					deflateSetDictionary(&z, &filtered[begin - dict_size], dict_size);
+				}
+
+				auto& out = compressed[band];
+				out.resize(deflateBound(&z, end - begin) + 16);
+
+				z.next_in = &filtered[begin];
+				z.avail_in = end - begin;
+				z.next_out = &out[0];
+				z.avail_out = out.size();
+
+				if (deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH) != (last ? Z_STREAM_END : Z_OK) || z.avail_in != 0)
+					panic("deflate failed");
+
+				out.resize(out.size() - z.avail_out);
+				deflateEnd(&z);
+
+				checksums[band] = adler32(adler32(0, nullptr, 0), &filtered[begin], end - begin);
+			});
+
+		for (size_t band = 0; band < num_bands; band++) {
+			const size_t rows = std::min((band + 1)*band_rows, im.height) - band*band_rows;
+			checksum = adler32_combine(checksum, checksums[band], rows*filtered_row_size);
+
+			write_chunk(f.s, "IDAT", &compressed[band][0], compressed[band].size());
+		}
+
+		pack_row(im, im.height - 1, &last_row[0]);
+
+		const size_t keep = std::min(filtered.size(), zlib_window_size);
+		filtered.erase(filtered.begin(), filtered.end() - keep);
+		history_size = keep;
+	}
+
+	png_byte zlib_trailer[4];
+	png_save_uint_32(zlib_trailer, checksum);
+	write_chunk(f.s, "IDAT", zlib_trailer, sizeof(zlib_trailer));
+
+	write_chunk(f.s, "IEND", nullptr, 0);
+}
+
+} // (anonymous namespace)
+
+png_options::png_options()
+: compression_level { 9 }
+, filter { png_filter::adaptive }
+, parallel_bands { false }
+, num_threads { 0 }
+{ }
+
 void
-png_write(const rgba_image&im, const std::string& path)
+png_write(const rgba_image& im, const std::string& path, const png_options& options)
 {
+	png_write(
+		im.width, im.height,
+		[&](size_t first_row, rgba_image& band)
+		{
+			band.copy(im, -static_cast<int>(first_row), 0);
+		},
+		path, options);
+}
+
+void
+png_write(size_t width, size_t height, const png_band_filler& fill_band, const std::string& path, const png_options& options)
+{
+	if (options.parallel_bands) {
+		png_write_bands(width, height, fill_band, path, options);
+		return;
+	}
+
 	png_structp png_ptr;
 
 	if ((png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, (png_voidp)NULL, NULL, NULL)) == NULL)
@@ -48,12 +380,13 @@ png_write(const rgba_image&im, const std::string& path)
 
 	png_init_io(png_ptr, f.s);
 
-	png_set_compression_level(png_ptr, 9);
+	png_set_compression_level(png_ptr, options.compression_level);
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, libpng_filter(options.filter));
 
 	png_set_IHDR(
 		png_ptr,
 		info_ptr,
-		im.width, im.height,
+		width, height,
 		8,
 		PNG_COLOR_TYPE_RGBA,
 		PNG_INTERLACE_NONE,
@@ -62,20 +395,16 @@ png_write(const rgba_image&im, const std::string& path)
 
 	png_write_info(png_ptr, info_ptr);
 
-	std::vector<png_byte> row(4*im.width);
+	std::vector<png_byte> row(4*width);
 
-	for (size_t i = 0; i < im.height; i++) {
-		auto it = std::begin(row);
+	for (size_t first_row = 0; first_row < height; first_row += band_rows) {
+		rgba_image band(width, std::min(band_rows, height - first_row));
+		fill_band(first_row, band);
 
-		for (size_t j = 0; j < im.width; j++) {
-			rgba<int> c { im(i, j) };
-			*it++ = c.r;
-			*it++ = c.g;
-			*it++ = c.b;
-			*it++ = c.a;
+		for (size_t i = 0; i < band.height; i++) {
+			pack_row(band, i, &row[0]);
+			png_write_row(png_ptr, &row[0]);
 		}
-
-		png_write_row(png_ptr, &row[0]);
 	}
 
 	png_write_end(png_ptr, info_ptr);
@@ -83,6 +412,50 @@ png_write(const rgba_image&im, const std::string& path)
 	png_destroy_write_struct(&png_ptr, &info_ptr);
 }
 
+void
+parse_png_compression(const char *str, png_options& options)
+{
+	if (!strcmp(str, "fast")) {
+		options.compression_level = 1;
+		options.filter = png_filter::up;
+	} else if (!strcmp(str, "max")) {
+		options.compression_level = 9;
+		options.filter = png_filter::adaptive;
+	} else {
+		char *end;
+		long level = strtol(str, &end, 10);
+
+		if (*end || level < 0 || level > 9)
+			panic("invalid compression level: %s", str);
+
+		options.compression_level = level;
+	}
+}
+
+png_filter
+parse_png_filter(const char *name)
+{
+	static const struct {
+		const char *name;
+		png_filter filter;
+	} filters[] = {
+		{ "none", png_filter::none },
+		{ "sub", png_filter::sub },
+		{ "up", png_filter::up },
+		{ "average", png_filter::average },
+		{ "paeth", png_filter::paeth },
+		{ "adaptive", png_filter::adaptive },
+	};
+
+	for (const auto& p : filters) {
+		if (!strcmp(p.name, name))
+			return p.filter;
+	}
+
+	panic("unknown png filter: %s", name);
+	return png_filter::adaptive;
+}
+
 rgba_image_ptr
 png_read(const std::string& path)
 {
@@ -131,3 +504,34 @@ png_read(const std::string& path)
 
 	return im;
 }
+
+void
+png_read_size(const std::string& path, size_t& width, size_t& height)
+{
+	file f { path, "rb" };
+
+	png_structp png_ptr;
+	if ((png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0)) == 0)
+		panic("png_create_read_struct failed");
+
+	png_infop info_ptr;
+	if ((info_ptr = png_create_info_struct(png_ptr)) == 0)
+		panic("png_create_info_struct failed");
+
+	if (setjmp(png_jmpbuf(png_ptr)))
+		panic("some kind of png error");
+
+	png_init_io(png_ptr, f.s);
+	png_read_info(png_ptr, info_ptr);
+
+	auto color_type = png_get_color_type(png_ptr, info_ptr);
+	auto bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+
+	if (bit_depth != 8 || color_type != PNG_COLOR_TYPE_RGBA)
+		panic("invalid bit depth in PNG: %s", path.c_str());
+
+	width = png_get_image_width(png_ptr, info_ptr);
+	height = png_get_image_height(png_ptr, info_ptr);
+
+	png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+}
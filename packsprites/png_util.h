@@ -2,6 +2,7 @@
 
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "rgba.h"
 #include "image.h"
@@ -9,8 +10,49 @@
 using rgba_image = image<uint32_t>;
 using rgba_image_ptr = std::unique_ptr<rgba_image>;
 
+// the values of the first five are the PNG filter types
+enum class png_filter
+{
+	none,
+	sub,
+	up,
+	average,
+	paeth,
+	adaptive, // best of the above for each row
+};
+
+struct png_options
+{
+	png_options();
+
+	int compression_level; // zlib level, 0 to 9
+	png_filter filter;
+
+	// compress bands of rows in parallel into a single zlib stream
+	bool parallel_bands;
+	int num_threads;
+};
+
+void
+png_write(const rgba_image& im, const std::string& path, const png_options& options = png_options());
+
+// fills a band of rows of the image, starting at first_row; bands are
+// requested in order, top to bottom
+using png_band_filler = std::function<void(size_t first_row, rgba_image& band)>;
+
+// writes the image a band of rows at a time, so that it's never in memory as a whole
+void
+png_write(size_t width, size_t height, const png_band_filler& fill_band, const std::string& path, const png_options& options = png_options());
+
 void
-png_write(const rgba_image& im, const std::string& path);
+parse_png_compression(const char *str, png_options& options);
+
+png_filter
+parse_png_filter(const char *name);
 
 rgba_image_ptr
 png_read(const std::string& path);
+
+// only reads the header
+void
+png_read_size(const std::string& path, size_t& width, size_t& height);
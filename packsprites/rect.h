@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cassert>
+#include <utility>
+
+struct rect
+{
+	rect()
+	: left_(0), top_(0), width_(0), height_(0)
+	{ }
+
+	rect(int left, int top, int width, int height)
+	: left_(left), top_(top), width_(width), height_(height)
+	{ }
+
+	int right() const
+	{ return left_ + width_; }
+
+	int bottom() const
+	{ return top_ + height_; }
+
+	bool contains(const rect& other) const
+	{
+		return other.left_ >= left_ && other.right() <= right() &&
+			other.top_ >= top_ && other.bottom() <= bottom();
+	}
+
+	bool intersects(const rect& other) const
+	{
+		return other.left_ < right() && other.right() > left_ &&
+			other.top_ < bottom() && other.bottom() > top_;
+	}
+
+	std::pair<rect, rect> split_vert(int c) const
+	{
+		assert(c < width_);
+		return std::pair<rect, rect>(rect(left_, top_, c, height_), rect(left_ + c, top_, width_ - c, height_));
+	}
+
+	std::pair<rect, rect> split_horiz(int r) const
+	{
+		assert(r < height_);
+		return std::pair<rect, rect>(rect(left_, top_, width_, r), rect(left_, top_ + r, width_, height_ - r));
+	}
+
+	int left_, top_, width_, height_;
+};
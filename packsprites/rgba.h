@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 template <template <typename> class Base, typename T>
 struct vec_ops
 {
@@ -0,0 +1,182 @@
+#include <cstring>
+#include <cerrno>
+
+#include "panic.h"
+#include "sheet_writer.h"
+
+namespace {
+
+// the characters TinyXML escapes in attribute values
+
+void
+write_escaped(FILE *out, const std::string& str)
+{
+	for (unsigned char c : str) {
+		switch (c) {
+			case '&':
+				fputs("&amp;", out);
+				break;
+
+			case '<':
+				fputs("&lt;", out);
+				break;
+
+			case '>':
+				fputs("&gt;", out);
+				break;
+
+			case '"':
+				fputs("&quot;", out);
+				break;
+
+			default:
+				if (c < 32)
+					fprintf(out, "&#x%02X;", c);
+				else
+					fputc(c, out);
+				break;
+		}
+	}
+}
+
+} // (anonymous namespace)
+
+attribute_sink::~attribute_sink() = default;
+
+xml_sheet_writer::xml_sheet_writer(const std::string& path)
+: out_ { fopen(path.c_str(), "w") }
+, buffer_(1 << 16)
+, section_ { nullptr }
+, has_textures_ { false }
+, has_sprites_ { false }
+{
+	if (!out_)
+		panic("fopen %s for write failed: %s", path.c_str(), strerror(errno));
+
+	setvbuf(out_, &buffer_[0], _IOFBF, buffer_.size());
+
+	fputs("<?xml version=\"1.0\" ?>\n<spritesheet>\n", out_);
+}
+
+xml_sheet_writer::~xml_sheet_writer()
+{
+	if (out_)
+		fclose(out_);
+}
+
+void
+xml_sheet_writer::begin_section(const char *name)
+{
+	if (section_ != name) {
+		end_section();
+		fprintf(out_, "    <%s>\n", name);
+		section_ = name;
+	}
+}
+
+void
+xml_sheet_writer::end_section()
+{
+	if (section_) {
+		fprintf(out_, "    </%s>\n", section_);
+		section_ = nullptr;
+	}
+}
+
+void
+xml_sheet_writer::texture(const std::string& path)
+{
+	begin_section("textures");
+	has_textures_ = true;
+
+	fputs("        <texture", out_);
+	attribute("path", path);
+	fputs(" />\n", out_);
+}
+
+// an empty textures section if there were no textures, so that it still
+// comes before the sprites
+void
+xml_sheet_writer::end_textures()
+{
+	if (!has_textures_) {
+		fputs("    <textures />\n", out_);
+		has_textures_ = true;
+	}
+}
+
+void
+xml_sheet_writer::begin_sprite()
+{
+	end_textures();
+	begin_section("sprites");
+	has_sprites_ = true;
+
+	fputs("        <sprite", out_);
+}
+
+void
+xml_sheet_writer::end_sprite()
+{
+	fputs(" />\n", out_);
+}
+
+// closes the last section, with empty textures and sprites sections if
+// there were none
+void
+xml_sheet_writer::end_sprites()
+{
+	end_section();
+	end_textures();
+
+	if (!has_sprites_) {
+		fputs("    <sprites />\n", out_);
+		has_sprites_ = true;
+	}
+}
+
+void
+xml_sheet_writer::kerning(int size, int left, int right, int amount)
+{
+	if (!has_sprites_)
+		end_sprites();
+
+	begin_section("kerning");
+
+	fputs("        <pair", out_);
+
+	if (size)
+		attribute("size", size);
+
+	attribute("left", left);
+	attribute("right", right);
+	attribute("amount", amount);
+	fputs(" />\n", out_);
+}
+
+void
+xml_sheet_writer::finish()
+{
+	end_sprites();
+
+	fputs("</spritesheet>\n", out_);
+
+	if (fclose(out_) != 0)
+		panic("write failed: %s", strerror(errno));
+
+	out_ = nullptr;
+}
+
+void
+xml_sheet_writer::attribute(const char *name, int value)
+{
+	fprintf(out_, " %s=\"%d\"", name, value);
+}
+
+void
+xml_sheet_writer::attribute(const char *name, const std::string& value)
+{
+	fprintf(out_, " %s=\"", name);
+	write_escaped(out_, value);
+	fputc('"', out_);
+}
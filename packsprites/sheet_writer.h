@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// receives the attributes of a sprite, see sprite_base::serialize
+class attribute_sink
+{
+public:
+	virtual ~attribute_sink();
+
+	virtual void attribute(const char *name, int value) = 0;
+	virtual void attribute(const char *name, const std::string& value) = 0;
+};
+
+// writes sprite sheet metadata out as it's generated: all the textures
+// first, then the attributes of each sprite between begin_sprite and
+// end_sprite, then the kerning pairs of fonts, sorted by size (0 if
+// there's only one), left code and right code, then finish
+class sheet_writer : public attribute_sink
+{
+public:
+	virtual void texture(const std::string& path) = 0;
+	virtual void begin_sprite() = 0;
+	virtual void end_sprite() = 0;
+	virtual void kerning(int size, int left, int right, int amount) = 0;
+	virtual void finish() = 0;
+};
+
+// the .spr XML file, in the same format TinyXML writes
+class xml_sheet_writer : public sheet_writer
+{
+public:
+	xml_sheet_writer(const std::string& path);
+	~xml_sheet_writer();
+
+	void texture(const std::string& path) override;
+	void begin_sprite() override;
+	void end_sprite() override;
+	void kerning(int size, int left, int right, int amount) override;
+	void finish() override;
+
+	void attribute(const char *name, int value) override;
+	void attribute(const char *name, const std::string& value) override;
+
+private:
+	void begin_section(const char *name);
+	void end_textures();
+	void end_sprites();
+	void end_section();
+
+	FILE *out_;
+	std::vector<char> buffer_;
+	const char *section_;
+	bool has_textures_;
+	bool has_sprites_;
+};
@@ -0,0 +1,131 @@
+#include <climits>
+#include <algorithm>
+
+#include "sprite_base.h"
+#include "skyline_packer.h"
+
+skyline_packer::skyline_packer(int width, int height, bool allow_rotation)
+: width_ { width }
+, height_ { height }
+, allow_rotation_ { allow_rotation }
+, skyline_ { segment { 0, 0, width } }
+{ }
+
+bool
+skyline_packer::insert(const sprite_base *sp, int border)
+{
+	const int wanted_width = sp->width() + 2*border;
+	const int wanted_height = sp->height() + 2*border;
+
+	// bottom-left: lowest resulting bottom edge, then leftmost
+
+	int best_bottom = INT_MAX;
+	int best_left = INT_MAX;
+	size_t best_index = 0;
+	rect best_rc;
+	bool best_rotated = false;
+
+	auto try_position = [&](size_t index, int width, int height, bool rotated)
+		{
+			int top;
+
+			if (fits(index, width, height, top)) {
+				const int bottom = top + height;
+				const int left = skyline_[index].left_;
+
+				if (bottom < best_bottom || (bottom == best_bottom && left < best_left)) {
+					best_bottom = bottom;
+					best_left = left;
+					best_index = index;
+					best_rc = rect { left, top, width, height };
+					best_rotated = rotated;
+				}
+			}
+		};
+
+	for (size_t i = 0; i < skyline_.size(); i++) {
+		try_position(i, wanted_width, wanted_height, false);
+
+		if (allow_rotation_ && wanted_width != wanted_height)
+			try_position(i, wanted_height, wanted_width, true);
+	}
+
+	if (best_bottom == INT_MAX)
+		return false;
+
+	add_segment(best_index, best_rc);
+
+	sprite_rects_.push_back({ sp, rect { best_rc.left_ + border, best_rc.top_ + border, best_rc.width_ - 2*border, best_rc.height_ - 2*border }, best_rotated });
+
+	return true;
+}
+
+std::vector<sprite_rect>
+skyline_packer::sprite_rects() const
+{
+	return sprite_rects_;
+}
+
+bool
+skyline_packer::fits(size_t index, int width, int height, int& top) const
+{
+	const int left = skyline_[index].left_;
+
+	if (left + width > width_)
+		return false;
+
+	// the sprite rests on the highest segment below it
+
+	int width_left = width;
+	top = 0;
+
+	for (size_t i = index; width_left > 0; i++) {
+		top = std::max(top, skyline_[i].top_);
+
+		if (top + height > height_)
+			return false;
+
+		width_left -= skyline_[i].width_;
+	}
+
+	return true;
+}
+
+void
+skyline_packer::add_segment(size_t index, const rect& rc)
+{
+	skyline_.insert(skyline_.begin() + index, segment { rc.left_, rc.bottom(), rc.width_ });
+
+	// shrink or remove the segments now covered by the new one
+
+	const size_t next = index + 1;
+
+	while (next < skyline_.size()) {
+		auto& s = skyline_[next];
+		const int covered = rc.right() - s.left_;
+
+		if (covered <= 0)
+			break;
+
+		if (covered < s.width_) {
+			s.left_ += covered;
+			s.width_ -= covered;
+			break;
+		}
+
+		skyline_.erase(skyline_.begin() + next);
+	}
+
+	// merge neighbours at the same height
+
+	size_t n = 0;
+
+	for (size_t i = 1; i < skyline_.size(); i++) {
+		if (skyline_[n].top_ == skyline_[i].top_)
+			skyline_[n].width_ += skyline_[i].width_;
+		else
+			skyline_[++n] = skyline_[i];
+	}
+
+	skyline_.resize(n + 1);
+}
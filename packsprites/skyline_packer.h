@@ -0,0 +1,30 @@
+#pragma once
+
+#include "packer.h"
+
+// skyline packer: only tracks the upper envelope of the placed sprites, so
+// each insertion is linear in the number of skyline segments; fast enough
+// for sheets with a huge number of small sprites
+
+class skyline_packer : public packer
+{
+public:
+	skyline_packer(int width, int height, bool allow_rotation);
+
+	bool insert(const sprite_base *sp, int border) override;
+	std::vector<sprite_rect> sprite_rects() const override;
+
+private:
+	struct segment
+	{
+		int left_, top_, width_;
+	};
+
+	bool fits(size_t index, int width, int height, int& top) const;
+	void add_segment(size_t index, const rect& rc);
+
+	int width_, height_;
+	bool allow_rotation_;
+	std::vector<segment> skyline_;
+	std::vector<sprite_rect> sprite_rects_;
+};
@@ -1,16 +1,94 @@
 #include <cstring>
+#include <algorithm>
 
-#include <tinyxml.h>
-
+#include "png_util.h"
+#include "panic.h"
+#include "sheet_writer.h"
 #include "sprite.h"
 
-sprite::sprite(const std::string& name, std::unique_ptr<image<uint32_t>> im)
+sprite::sprite(const std::string& name, const std::string& path, std::unique_ptr<image<uint32_t>> im)
 : sprite_base { std::move(im) }
 , name_ { name }
+, path_ { path }
+, trimmed_ { false }
+, offset_x_ { 0 }
+, offset_y_ { 0 }
+, orig_width_ { static_cast<int>(width()) }
+, orig_height_ { static_cast<int>(height()) }
+{ }
+
+sprite::sprite(const std::string& name, const std::string& path, size_t width, size_t height)
+: sprite_base { width, height }
+, name_ { name }
+, path_ { path }
+, trimmed_ { false }
+, offset_x_ { 0 }
+, offset_y_ { 0 }
+, orig_width_ { static_cast<int>(width) }
+, orig_height_ { static_cast<int>(height) }
 { }
 
 void
-sprite::serialize(TiXmlElement *el) const
+sprite::trim()
 {
-	el->SetAttribute("name", name_);
+	const auto& im = *image_;
+
+	int left = im.width, right = -1;
+	int top = im.height, bottom = -1;
+
+	for (int i = 0; i < im.height; i++) {
+		for (int j = 0; j < im.width; j++) {
+			if (im(i, j) >> 24) {
+				left = std::min(left, j);
+				right = std::max(right, j);
+				top = std::min(top, i);
+				bottom = std::max(bottom, i);
+			}
+		}
+	}
+
+	// keep a single pixel of fully transparent sprites
+
+	if (right < 0)
+		left = right = top = bottom = 0;
+
+	trimmed_ = true;
+	offset_x_ = left;
+	offset_y_ = top;
+
+	if (left > 0 || top > 0 || right < im.width - 1 || bottom < im.height - 1)
+		set_image(std::unique_ptr<image<uint32_t>> { new image<uint32_t> { im.sub_image(top, left, right - left + 1, bottom - top + 1) } });
+}
+
+void
+sprite::unload()
+{
+	image_.reset();
+}
+
+std::unique_ptr<image<uint32_t>>
+sprite::load_image() const
+{
+	auto im = png_read(path_);
+
+	if (im->width != orig_width_ || im->height != orig_height_)
+		panic("%s changed while packing", path_.c_str());
+
+	if (im->width != width() || im->height != height())
+		im.reset(new image<uint32_t> { im->sub_image(offset_y_, offset_x_, width(), height()) });
+
+	return im;
+}
+
+void
+sprite::serialize(attribute_sink& out) const
+{
+	out.attribute("name", name_);
+
+	if (trimmed_) {
+		out.attribute("ox", offset_x_);
+		out.attribute("oy", offset_y_);
+		out.attribute("ow", orig_width_);
+		out.attribute("oh", orig_height_);
+	}
 }
@@ -6,9 +6,25 @@
 
 struct sprite : sprite_base
 {
-	sprite(const std::string& name, std::unique_ptr<image<uint32_t>> im);
+	sprite(const std::string& name, const std::string& path, std::unique_ptr<image<uint32_t>> im);
 
-	void serialize(TiXmlElement *el) const override;
+	// the image is only decoded when needed
+	sprite(const std::string& name, const std::string& path, size_t width, size_t height);
+
+	// crop fully transparent margins
+	void trim();
+
+	// drop the image, to be decoded again when needed
+	void unload();
+
+	void serialize(attribute_sink& out) const override;
+	std::unique_ptr<image<uint32_t>> load_image() const override;
 
 	std::string name_;
+	std::string path_;
+
+	// position of the trimmed image in the original one
+	bool trimmed_;
+	int offset_x_, offset_y_;
+	int orig_width_, orig_height_;
 };
@@ -1,7 +1,63 @@
+#include "hash.h"
+#include "panic.h"
 #include "sprite_base.h"
 
 sprite_base::sprite_base(std::unique_ptr<image<uint32_t>> image)
-: image_ { std::move(image) }
+: alias_of_ { nullptr }
+{
+	set_image(std::move(image));
+}
+
+sprite_base::sprite_base(size_t width, size_t height)
+: width_ { width }
+, height_ { height }
+, hash_ { 0 }
+, alias_of_ { nullptr }
+{ }
+
+sprite_base::sprite_base(const sprite_base *other)
+: width_ { other->width_ }
+, height_ { other->height_ }
+, hash_ { other->hash_ }
+, alias_of_ { other }
 { }
 
 sprite_base::~sprite_base() = default;
+
+std::unique_ptr<image<uint32_t>>
+sprite_base::load_image() const
+{
+	panic("sprite image not loaded");
+	return nullptr;
+}
+
+const image<uint32_t>&
+sprite_base::get_image(std::unique_ptr<image<uint32_t>>& temp) const
+{
+	if (image_)
+		return *image_;
+
+	temp = load_image();
+	return *temp;
+}
+
+bool
+sprite_base::same_image(const sprite_base& other) const
+{
+	if (hash_ != other.hash_ || width() != other.width() || height() != other.height())
+		return false;
+
+	std::unique_ptr<image<uint32_t>> temp, other_temp;
+	return get_image(temp).pixels == other.get_image(other_temp).pixels;
+}
+
+void
+sprite_base::set_image(std::unique_ptr<image<uint32_t>> image)
+{
+	image_ = std::move(image);
+	width_ = image_->width;
+	height_ = image_->height;
+
+	const auto& pixels = image_->pixels;
+	hash_ = hash64(pixels.data(), pixels.size()*sizeof(pixels[0]), width_);
+}
@@ -6,20 +6,43 @@
 
 #include "image.h"
 
-class TiXmlElement;
+class attribute_sink;
 
 struct sprite_base
 {
 	sprite_base(std::unique_ptr<image<uint32_t>> im);
+
+	// for sprites whose image isn't kept in memory, see load_image
+	sprite_base(size_t width, size_t height);
+
+	// for a sprite known to have the same image as other: it isn't packed,
+	// it's written out with the rectangle of other
+	sprite_base(const sprite_base *other);
+
 	virtual ~sprite_base();
 
 	size_t width() const
-	{ return image_->width; }
+	{ return width_; }
 
 	size_t height() const
-	{ return image_->height; }
+	{ return height_; }
+
+	virtual void serialize(attribute_sink& out) const = 0;
+
+	// decodes the image again, for sprites that dropped it
+	virtual std::unique_ptr<image<uint32_t>> load_image() const;
+
+	// the image, loaded into temp if it isn't in memory
+	const image<uint32_t>& get_image(std::unique_ptr<image<uint32_t>>& temp) const;
+
+	// same size and pixels
+	bool same_image(const sprite_base& other) const;
 
-	virtual void serialize(TiXmlElement *el) const = 0;
+	// replaces the image, updating size and hash
+	void set_image(std::unique_ptr<image<uint32_t>> im);
 
+	size_t width_, height_;
 	std::unique_ptr<image<uint32_t>> image_;
+	uint64_t hash_;
+	const sprite_base *alias_of_;
 };
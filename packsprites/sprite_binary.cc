@@ -0,0 +1,261 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+
+#include "hash.h"
+#include "panic.h"
+#include "sprite_binary.h"
+
+namespace {
+
+class output_buffer
+{
+public:
+	void put_u16(uint16_t v)
+	{
+		data_.push_back(v & 0xff);
+		data_.push_back((v >> 8) & 0xff);
+	}
+
+	void put_u32(uint32_t v)
+	{
+		for (int i = 0; i < 4; i++)
+			data_.push_back((v >> 8*i) & 0xff);
+	}
+
+	void put_bytes(const char *bytes, size_t size)
+	{ data_.insert(std::end(data_), bytes, bytes + size); }
+
+	void write(const std::string& path) const
+	{
+		FILE *f = fopen(path.c_str(), "wb");
+
+		if (!f)
+			panic("fopen %s for write failed: %s", path.c_str(), strerror(errno));
+
+		if (fwrite(&data_[0], 1, data_.size(), f) != data_.size())
+			panic("write failed: %s", strerror(errno));
+
+		fclose(f);
+	}
+
+private:
+	std::vector<uint8_t> data_;
+};
+
+uint16_t
+to_u16(int v)
+{
+	if (v < 0 || v > 0xffff)
+		panic("value out of range for binary metadata: %d", v);
+
+	return v;
+}
+
+int16_t
+to_s16(int v)
+{
+	if (v < -0x8000 || v > 0x7fff)
+		panic("value out of range for binary metadata: %d", v);
+
+	return v;
+}
+
+} // (anonymous namespace)
+
+uint64_t
+sprb_hash(const void *key, size_t size)
+{
+	return hash64(key, size);
+}
+
+binary_sheet_writer::binary_sheet_writer(const std::string& path)
+: path_ { path }
+{ }
+
+uint32_t
+binary_sheet_writer::add_string(const std::string& str)
+{
+	const uint32_t offset = strings_.size();
+	strings_.insert(std::end(strings_), str.c_str(), str.c_str() + str.size() + 1);
+	return offset;
+}
+
+void
+binary_sheet_writer::texture(const std::string& path)
+{
+	textures_.push_back(add_string(path));
+}
+
+void
+binary_sheet_writer::begin_sprite()
+{
+	sprb_sprite s;
+	memset(&s, 0, sizeof(s));
+	s.name = sprb_none;
+
+	sprites_.push_back(s);
+	hashes_.push_back(0);
+}
+
+void
+binary_sheet_writer::end_sprite()
+{
+	auto& s = sprites_.back();
+
+	if (s.name != sprb_none) {
+		hashes_.back() = sprb_hash(&strings_[s.name], strlen(&strings_[s.name]));
+	} else if (s.flags & sprb_glyph) {
+		const uint32_t code = s.code;
+		const uint32_t size = s.size;
+		const uint8_t key[8] = {
+			static_cast<uint8_t>(code), static_cast<uint8_t>(code >> 8),
+			static_cast<uint8_t>(code >> 16), static_cast<uint8_t>(code >> 24),
+			static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
+			static_cast<uint8_t>(size >> 16), static_cast<uint8_t>(size >> 24) };
+		hashes_.back() = sprb_hash(key, size ? 8 : 4);
+	}
+}
+
+void
+binary_sheet_writer::kerning(int size, int left, int right, int amount)
+{
+	kerning_.push_back(sprb_kerning { left, right, to_s16(amount), to_u16(size) });
+}
+
+void
+binary_sheet_writer::attribute(const char *name, int value)
+{
+	auto& s = sprites_.back();
+
+	if (!strcmp(name, "x")) {
+		s.x = to_u16(value);
+	} else if (!strcmp(name, "y")) {
+		s.y = to_u16(value);
+	} else if (!strcmp(name, "w")) {
+		s.w = to_u16(value);
+	} else if (!strcmp(name, "h")) {
+		s.h = to_u16(value);
+	} else if (!strcmp(name, "tex")) {
+		s.tex = to_u16(value);
+	} else if (!strcmp(name, "rotated")) {
+		if (value)
+			s.flags |= sprb_rotated;
+	} else if (!strcmp(name, "ox")) {
+		s.ox = to_s16(value);
+		s.flags |= sprb_trimmed;
+	} else if (!strcmp(name, "oy")) {
+		s.oy = to_s16(value);
+	} else if (!strcmp(name, "ow")) {
+		s.ow = to_u16(value);
+	} else if (!strcmp(name, "oh")) {
+		s.oh = to_u16(value);
+	} else if (!strcmp(name, "code")) {
+		s.code = value;
+		s.flags |= sprb_glyph;
+	} else if (!strcmp(name, "left")) {
+		s.left = to_s16(value);
+	} else if (!strcmp(name, "top")) {
+		s.top = to_s16(value);
+	} else if (!strcmp(name, "advancex")) {
+		s.advance_x = to_s16(value);
+	} else if (!strcmp(name, "size")) {
+		s.size = to_u16(value);
+	}
+}
+
+void
+binary_sheet_writer::attribute(const char *name, const std::string& value)
+{
+	if (!strcmp(name, "name"))
+		sprites_.back().name = add_string(value);
+}
+
+void
+binary_sheet_writer::finish()
+{
+	// hash index, at most half full
+
+	uint32_t hash_size = 1;
+
+	while (hash_size < 2*sprites_.size())
+		hash_size *= 2;
+
+	std::vector<uint32_t> hash_index(hash_size, sprb_none);
+
+	for (size_t i = 0; i < sprites_.size(); i++) {
+		const auto& s = sprites_[i];
+
+		if (s.name == sprb_none && !(s.flags & sprb_glyph))
+			continue;
+
+		size_t slot = hashes_[i] % hash_size;
+
+		while (hash_index[slot] != sprb_none)
+			slot = (slot + 1) % hash_size;
+
+		hash_index[slot] = i;
+	}
+
+	// padded to keep the file size a multiple of 4
+	while (strings_.size() % 4)
+		strings_.push_back(0);
+
+	const uint32_t textures_offset = sizeof(sprb_header);
+	const uint32_t sprites_offset = textures_offset + 4*textures_.size();
+	const uint32_t hash_offset = sprites_offset + sizeof(sprb_sprite)*sprites_.size();
+	const uint32_t kerning_offset = hash_offset + 4*hash_size;
+	const uint32_t strings_offset = kerning_offset + sizeof(sprb_kerning)*kerning_.size();
+
+	output_buffer out;
+
+	out.put_u32(sprb_magic);
+	out.put_u32(sprb_version);
+	out.put_u32(textures_.size());
+	out.put_u32(textures_offset);
+	out.put_u32(sprites_.size());
+	out.put_u32(sprites_offset);
+	out.put_u32(hash_size);
+	out.put_u32(hash_offset);
+	out.put_u32(strings_.size());
+	out.put_u32(strings_offset);
+	out.put_u32(kerning_.size());
+	out.put_u32(kerning_offset);
+
+	for (auto offset : textures_)
+		out.put_u32(offset);
+
+	for (const auto& s : sprites_) {
+		out.put_u32(s.name);
+		out.put_u32(s.code);
+		out.put_u16(s.x);
+		out.put_u16(s.y);
+		out.put_u16(s.w);
+		out.put_u16(s.h);
+		out.put_u16(s.tex);
+		out.put_u16(s.flags);
+		out.put_u16(s.ox);
+		out.put_u16(s.oy);
+		out.put_u16(s.ow);
+		out.put_u16(s.oh);
+		out.put_u16(s.left);
+		out.put_u16(s.top);
+		out.put_u16(s.advance_x);
+		out.put_u16(s.size);
+	}
+
+	for (auto index : hash_index)
+		out.put_u32(index);
+
+	for (const auto& k : kerning_) {
+		out.put_u32(k.left);
+		out.put_u32(k.right);
+		out.put_u16(k.amount);
+		out.put_u16(k.size);
+	}
+
+	out.put_bytes(strings_.data(), strings_.size());
+
+	out.write(path_);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sheet_writer.h"
+
+// binary sprite sheet metadata (.sprb), laid out so that it can be mapped
+// into memory and used as is. all fields are little-endian, offsets are in
+// bytes from the start of the file, and everything is 4-byte aligned.
+//
+// to look up a sprite, hash its key with sprb_hash and probe the hash index
+// linearly from slot hash % hash_size until a matching sprite or an empty
+// slot (sprb_none). the key of a sprite is its name; the key of a glyph is
+// its code, as 4 little-endian bytes, followed by its size, also as 4
+// little-endian bytes, if it has one.
+//
+// kerning pairs are sorted by size, left code and right code, for a binary
+// search.
+
+const uint32_t sprb_magic = 0x62727073; // "sprb"
+const uint32_t sprb_version = 3;
+
+// no string / no sprite
+const uint32_t sprb_none = 0xffffffff;
+
+struct sprb_header
+{
+	uint32_t magic;
+	uint32_t version;
+
+	uint32_t num_textures;
+	uint32_t textures_offset; // string offset of the path of each texture
+
+	uint32_t num_sprites;
+	uint32_t sprites_offset; // sprb_sprite records, in .spr order
+
+	uint32_t hash_size; // a power of two
+	uint32_t hash_offset; // sprite index per slot
+
+	uint32_t strings_size;
+	uint32_t strings_offset; // pool of nul-terminated strings
+
+	uint32_t num_kerning_pairs;
+	uint32_t kerning_offset; // sprb_kerning records
+};
+
+enum sprb_flags
+{
+	sprb_rotated = 1,
+	sprb_trimmed = 2,
+	sprb_glyph = 4,
+};
+
+struct sprb_sprite
+{
+	uint32_t name; // string offset, or sprb_none
+	int32_t code; // glyphs only
+
+	uint16_t x, y, w, h;
+	uint16_t tex;
+	uint16_t flags;
+
+	// trimmed sprites only
+	int16_t ox, oy;
+	uint16_t ow, oh;
+
+	// glyphs only
+	int16_t left, top;
+	int16_t advance_x;
+	uint16_t size; // 0 if the sheet has only one
+};
+
+struct sprb_kerning
+{
+	int32_t left, right; // codes
+	int16_t amount;
+	uint16_t size; // 0 if the sheet has only one
+};
+
+static_assert(sizeof(sprb_header) == 48, "unexpected sprb_header size");
+static_assert(sizeof(sprb_sprite) == 36, "unexpected sprb_sprite size");
+static_assert(sizeof(sprb_kerning) == 12, "unexpected sprb_kerning size");
+
+// XXH64 of the key, seed 0
+uint64_t
+sprb_hash(const void *key, size_t size);
+
+// the .sprb file, written out at finish
+class binary_sheet_writer : public sheet_writer
+{
+public:
+	binary_sheet_writer(const std::string& path);
+
+	void texture(const std::string& path) override;
+	void begin_sprite() override;
+	void end_sprite() override;
+	void kerning(int size, int left, int right, int amount) override;
+	void finish() override;
+
+	void attribute(const char *name, int value) override;
+	void attribute(const char *name, const std::string& value) override;
+
+private:
+	uint32_t add_string(const std::string& str);
+
+	std::string path_;
+	std::vector<uint32_t> textures_;
+	std::vector<sprb_sprite> sprites_;
+	std::vector<uint64_t> hashes_;
+	std::vector<char> strings_;
+	std::vector<sprb_kerning> kerning_;
+};
@@ -0,0 +1,497 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <set>
+#include <algorithm>
+#include <tuple>
+
+#include "panic.h"
+#include "sprite_header.h"
+
+namespace {
+
+// the same code is written into the generated header, as constexpr
+
+const char *hash_functions =
+	"constexpr uint32_t mix0(uint32_t h) { return (h ^ (h >> 16))*0x45d9f3bu; }\n"
+	"constexpr uint32_t mix1(uint32_t h) { return h ^ (h >> 16); }\n"
+	"\n"
+	"constexpr uint32_t fnv1a(const char *s, uint32_t h)\n"
+	"{ return *s ? fnv1a(s + 1, (h ^ static_cast<unsigned char>(*s))*16777619u) : h; }\n"
+	"\n"
+	"constexpr uint32_t hash(const char *s, uint32_t seed)\n"
+	"{ return mix1(mix0(fnv1a(s, 2166136261u ^ seed))); }\n";
+
+uint32_t
+fnv1a(const char *s, uint32_t h)
+{
+	for (; *s; ++s)
+		h = (h ^ static_cast<unsigned char>(*s))*16777619u;
+	return h;
+}
+
+// C++11 keywords and alternative tokens, which can't be identifiers
+
+const char *reserved_words[] = {
+	"alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+	"bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
+	"compl", "const", "const_cast", "constexpr", "continue", "decltype",
+	"default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+	"explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+	"if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+	"not", "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+	"protected", "public", "register", "reinterpret_cast", "return", "short",
+	"signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+	"switch", "template", "this", "thread_local", "throw", "true", "try",
+	"typedef", "typeid", "typename", "union", "unsigned", "using", "virtual",
+	"void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+};
+
+// sprite names as C++ identifiers, without the .png extension
+
+std::string
+identifier(std::string name)
+{
+	const std::string extension = ".png";
+
+	if (name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+		name.erase(name.size() - extension.size());
+
+	for (auto& c : name) {
+		if (!isalnum(static_cast<unsigned char>(c)))
+			c = '_';
+	}
+
+	if (name.empty() || isdigit(static_cast<unsigned char>(name[0])))
+		name.insert(0, "_");
+
+	for (auto word : reserved_words) {
+		if (name == word) {
+			name += "_";
+			break;
+		}
+	}
+
+	return name;
+}
+
+std::string
+quoted(const std::string& str)
+{
+	std::string rv = "\"";
+
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			rv += '\\';
+		rv += c;
+	}
+
+	return rv + "\"";
+}
+
+// hash and displace: names are spread into buckets by their hash with seed 0,
+// then, biggest bucket first, each bucket gets the first seed that puts all
+// its names in free slots
+
+void
+perfect_hash(const std::vector<std::string>& names, std::vector<uint32_t>& bucket_seeds, std::vector<int>& slots)
+{
+	const size_t num_buckets = names.size()/2 + 1;
+	const size_t num_slots = names.size() + names.size()/4 + 1;
+
+	std::vector<std::vector<size_t>> buckets(num_buckets);
+
+	for (size_t i = 0; i < names.size(); i++)
+		buckets[sprite_header_hash(names[i].c_str(), 0) % num_buckets].push_back(i);
+
+	std::vector<size_t> order(num_buckets);
+
+	for (size_t i = 0; i < num_buckets; i++)
+		order[i] = i;
+
+	std::stable_sort(
+		std::begin(order),
+		std::end(order),
+		[&](size_t a, size_t b)
+		{
+			return buckets[a].size() > buckets[b].size();
+		});
+
+	bucket_seeds.assign(num_buckets, 0);
+	slots.assign(num_slots, -1);
+
+	for (auto bucket : order) {
+		const auto& keys = buckets[bucket];
+
+		if (keys.empty())
+			break;
+
+		uint32_t seed = 1;
+
+		for (;;) {
+			std::vector<size_t> taken;
+
+			for (auto key : keys) {
+				const size_t slot = sprite_header_hash(names[key].c_str(), seed) % num_slots;
+
+				if (slots[slot] != -1 || std::find(std::begin(taken), std::end(taken), slot) != std::end(taken))
+					break;
+
+				taken.push_back(slot);
+			}
+
+			if (taken.size() == keys.size()) {
+				for (size_t i = 0; i < keys.size(); i++)
+					slots[taken[i]] = keys[i];
+				break;
+			}
+
+			if (++seed == 0)
+				panic("no perfect hash for the sprite names");
+		}
+
+		bucket_seeds[bucket] = seed;
+	}
+}
+
+} // (anonymous namespace)
+
+uint32_t
+sprite_header_hash(const char *name, uint32_t seed)
+{
+	uint32_t h = fnv1a(name, 2166136261u ^ seed);
+	h = (h ^ (h >> 16))*0x45d9f3bu;
+	return h ^ (h >> 16);
+}
+
+header_sheet_writer::header_sheet_writer(const std::string& path, const std::string& namespace_name)
+: path_ { path }
+, namespace_name_ { identifier(namespace_name) }
+{ }
+
+void
+header_sheet_writer::texture(const std::string& path)
+{
+	textures_.push_back(path);
+}
+
+void
+header_sheet_writer::begin_sprite()
+{
+	entries_.push_back(entry {});
+}
+
+void
+header_sheet_writer::end_sprite()
+{
+	auto& e = entries_.back();
+
+	if (!e.trimmed_) {
+		e.ow_ = e.w_;
+		e.oh_ = e.h_;
+	}
+}
+
+void
+header_sheet_writer::kerning(int size, int left, int right, int amount)
+{
+	kerning_.push_back(kerning_pair { size, left, right, amount });
+}
+
+void
+header_sheet_writer::attribute(const char *name, int value)
+{
+	auto& e = entries_.back();
+
+	static const struct {
+		const char *name;
+		int entry::*field;
+	} fields[] = {
+		{ "x", &entry::x_ },
+		{ "y", &entry::y_ },
+		{ "w", &entry::w_ },
+		{ "h", &entry::h_ },
+		{ "tex", &entry::tex_ },
+		{ "ox", &entry::ox_ },
+		{ "oy", &entry::oy_ },
+		{ "ow", &entry::ow_ },
+		{ "oh", &entry::oh_ },
+		{ "code", &entry::code_ },
+		{ "left", &entry::left_ },
+		{ "top", &entry::top_ },
+		{ "advancex", &entry::advance_x_ },
+		{ "size", &entry::size_ },
+	};
+
+	for (const auto& f : fields) {
+		if (!strcmp(f.name, name))
+			e.*f.field = value;
+	}
+
+	if (!strcmp(name, "rotated"))
+		e.rotated_ = value != 0;
+	else if (!strcmp(name, "ox"))
+		e.trimmed_ = true;
+	else if (!strcmp(name, "code"))
+		e.glyph_ = true;
+}
+
+void
+header_sheet_writer::attribute(const char *name, const std::string& value)
+{
+	if (!strcmp(name, "name"))
+		entries_.back().name_ = value;
+}
+
+void
+header_sheet_writer::finish()
+{
+	FILE *out = fopen(path_.c_str(), "w");
+
+	if (!out)
+		panic("fopen %s for write failed: %s", path_.c_str(), strerror(errno));
+
+	fprintf(out,
+		"// generated by packsprites, do not edit\n"
+		"\n"
+		"#pragma once\n"
+		"\n"
+		"#include <cstdint>\n"
+		"\n"
+		"namespace %s {\n"
+		"\n"
+		"struct sprite\n"
+		"{\n"
+		"\tint x, y, w, h;\n"
+		"\tint tex;\n"
+		"\tbool rotated;\n"
+		"\n"
+		"\t// position and size of the trimmed image in the original one\n"
+		"\tint ox, oy, ow, oh;\n"
+		"\n"
+		"\t// glyphs only\n"
+		"\tint code, left, top, advance_x;\n"
+		"\tint size; // 0 if the sheet has only one\n"
+		"};\n"
+		"\n",
+		namespace_name_.c_str());
+
+	fprintf(out, "constexpr int num_textures = %zu;\n", textures_.size());
+
+	if (!textures_.empty()) {
+		fprintf(out, "\nconstexpr const char *textures[] = {\n");
+
+		for (const auto& path : textures_)
+			fprintf(out, "\t%s,\n", quoted(path).c_str());
+
+		fprintf(out, "};\n");
+	}
+
+	fprintf(out, "\nconstexpr int num_sprites = %zu;\n", entries_.size());
+
+	if (!entries_.empty()) {
+		fprintf(out, "\nconstexpr sprite sprites[] = {\n");
+
+		for (const auto& e : entries_) {
+			fprintf(out, "\t{ %d, %d, %d, %d, %d, %s, %d, %d, %d, %d, %d, %d, %d, %d, %d }, // %s\n",
+				e.x_, e.y_, e.w_, e.h_, e.tex_, e.rotated_ ? "true" : "false",
+				e.ox_, e.oy_, e.ow_, e.oh_,
+				e.code_, e.left_, e.top_, e.advance_x_, e.size_,
+				e.glyph_ ? std::to_string(e.code_).c_str() : e.name_.c_str());
+		}
+
+		fprintf(out, "};\n");
+	}
+
+	// names
+
+	std::vector<std::string> names;
+	std::vector<int> name_indices;
+
+	for (size_t i = 0; i < entries_.size(); i++) {
+		if (!entries_[i].glyph_) {
+			names.push_back(entries_[i].name_);
+			name_indices.push_back(i);
+		}
+	}
+
+	if (!names.empty()) {
+		// enumerators are made unique with a suffix
+
+		std::set<std::string> used;
+
+		fprintf(out, "\nenum class sprite_id : int\n{\n");
+
+		for (size_t i = 0; i < names.size(); i++) {
+			auto id = identifier(names[i]);
+
+			for (int n = 2; !used.insert(id).second; n++)
+				id = identifier(names[i]) + "_" + std::to_string(n);
+
+			fprintf(out, "\t%s = %d,\n", id.c_str(), name_indices[i]);
+		}
+
+		fprintf(out, "};\n");
+
+		// only the first sprite with each name can be found, as in the
+		// .sprb index: identical names would never get slots of their own
+
+		std::vector<std::string> unique_names;
+		std::vector<int> unique_indices;
+		std::set<std::string> hashed;
+
+		for (size_t i = 0; i < names.size(); i++) {
+			if (hashed.insert(names[i]).second) {
+				unique_names.push_back(names[i]);
+				unique_indices.push_back(name_indices[i]);
+			}
+		}
+
+		std::vector<uint32_t> bucket_seeds;
+		std::vector<int> slots;
+		perfect_hash(unique_names, bucket_seeds, slots);
+
+		fprintf(out, "\nnamespace detail {\n\n%s\n", hash_functions);
+
+		fprintf(out, "constexpr uint32_t bucket_seeds[] = {");
+
+		for (size_t i = 0; i < bucket_seeds.size(); i++)
+			fprintf(out, "%s%u,", i % 16 ? " " : "\n\t", bucket_seeds[i]);
+
+		fprintf(out, "\n};\n\nconstexpr int slots[] = {");
+
+		for (size_t i = 0; i < slots.size(); i++)
+			fprintf(out, "%s%d,", i % 16 ? " " : "\n\t", slots[i] == -1 ? -1 : unique_indices[slots[i]]);
+
+		fprintf(out, "\n};\n\nconstexpr const char *names[] = {\n");
+
+		for (size_t i = 0; i < entries_.size(); i++)
+			fprintf(out, "\t%s,\n", entries_[i].glyph_ ? "nullptr" : quoted(entries_[i].name_).c_str());
+
+		fprintf(out,
+			"};\n"
+			"\n"
+			"constexpr bool equal(const char *a, const char *b)\n"
+			"{ return *a == *b && (*a == '\\0' || equal(a + 1, b + 1)); }\n"
+			"\n"
+			"constexpr int check(int index, const char *name)\n"
+			"{ return index != -1 && equal(names[index], name) ? index : -1; }\n"
+			"\n"
+			"constexpr int slot(const char *name)\n"
+			"{ return slots[hash(name, bucket_seeds[hash(name, 0) %% %zu]) %% %zu]; }\n"
+			"\n"
+			"} // namespace detail\n"
+			"\n"
+			"// index of the sprite with the given name, or -1\n"
+			"constexpr int find(const char *name)\n"
+			"{ return detail::check(detail::slot(name), name); }\n",
+			bucket_seeds.size(), slots.size());
+	}
+
+	// glyphs are sorted by size and code for a binary search
+
+	std::vector<std::tuple<int, int, int>> codes;
+
+	for (size_t i = 0; i < entries_.size(); i++) {
+		if (entries_[i].glyph_)
+			codes.emplace_back(entries_[i].size_, entries_[i].code_, i);
+	}
+
+	if (!codes.empty()) {
+		std::stable_sort(std::begin(codes), std::end(codes));
+
+		fprintf(out, "\nnamespace detail {\n\nconstexpr int glyph_sizes[] = {");
+
+		for (size_t i = 0; i < codes.size(); i++)
+			fprintf(out, "%s%d,", i % 16 ? " " : "\n\t", std::get<0>(codes[i]));
+
+		fprintf(out, "\n};\n\nconstexpr int glyph_codes[] = {");
+
+		for (size_t i = 0; i < codes.size(); i++)
+			fprintf(out, "%s%d,", i % 16 ? " " : "\n\t", std::get<1>(codes[i]));
+
+		fprintf(out, "\n};\n\nconstexpr int glyph_indices[] = {");
+
+		for (size_t i = 0; i < codes.size(); i++)
+			fprintf(out, "%s%d,", i % 16 ? " " : "\n\t", std::get<2>(codes[i]));
+
+		fprintf(out,
+			"\n};\n"
+			"\n"
+			"constexpr bool glyph_less(int i, int code, int size)\n"
+			"{ return glyph_sizes[i] < size || (glyph_sizes[i] == size && glyph_codes[i] < code); }\n"
+			"\n"
+			"constexpr int lower_bound(int code, int size, int first, int count)\n"
+			"{\n"
+			"\treturn count == 0 ? first :\n"
+			"\t\tglyph_less(first + count/2, code, size) ? lower_bound(code, size, first + count/2 + 1, count - count/2 - 1) :\n"
+			"\t\tlower_bound(code, size, first, count/2);\n"
+			"}\n"
+			"\n"
+			"constexpr int check_glyph(int i, int code, int size)\n"
+			"{ return i < %zu && glyph_codes[i] == code && glyph_sizes[i] == size ? glyph_indices[i] : -1; }\n"
+			"\n"
+			"} // namespace detail\n"
+			"\n"
+			"// index of the first glyph with the given code and size (0 if the\n"
+			"// sheet has only one), or -1\n"
+			"constexpr int find_glyph(int code, int size = 0)\n"
+			"{ return detail::check_glyph(detail::lower_bound(code, size, 0, %zu), code, size); }\n",
+			codes.size(), codes.size());
+	}
+
+	// kerning pairs come sorted, for another binary search
+
+	if (!kerning_.empty()) {
+		fprintf(out,
+			"\n"
+			"struct kerning_pair\n"
+			"{\n"
+			"\tint size;\n"
+			"\tint left, right;\n"
+			"\tint amount;\n"
+			"};\n"
+			"\n"
+			"constexpr int num_kerning_pairs = %zu;\n"
+			"\n"
+			"constexpr kerning_pair kerning_pairs[] = {\n",
+			kerning_.size());
+
+		for (const auto& k : kerning_)
+			fprintf(out, "\t{ %d, %d, %d, %d },\n", k.size_, k.left_, k.right_, k.amount_);
+
+		fprintf(out,
+			"};\n"
+			"\n"
+			"namespace detail {\n"
+			"\n"
+			"constexpr bool kerning_less(const kerning_pair& k, int left, int right, int size)\n"
+			"{ return k.size < size || (k.size == size && (k.left < left || (k.left == left && k.right < right))); }\n"
+			"\n"
+			"constexpr int kerning_lower_bound(int left, int right, int size, int first, int count)\n"
+			"{\n"
+			"\treturn count == 0 ? first :\n"
+			"\t\tkerning_less(kerning_pairs[first + count/2], left, right, size) ? kerning_lower_bound(left, right, size, first + count/2 + 1, count - count/2 - 1) :\n"
+			"\t\tkerning_lower_bound(left, right, size, first, count/2);\n"
+			"}\n"
+			"\n"
+			"constexpr int check_kerning(const kerning_pair& k, int left, int right, int size)\n"
+			"{ return k.size == size && k.left == left && k.right == right ? k.amount : 0; }\n"
+			"\n"
+			"constexpr int find_kerning(int i, int left, int right, int size)\n"
+			"{ return i < num_kerning_pairs ? check_kerning(kerning_pairs[i], left, right, size) : 0; }\n"
+			"\n"
+			"} // namespace detail\n"
+			"\n"
+			"// kerning between the glyphs with the given codes and size (0 if the\n"
+			"// sheet has only one), 0 if there's none\n"
+			"constexpr int kerning(int left, int right, int size = 0)\n"
+			"{ return detail::find_kerning(detail::kerning_lower_bound(left, right, size, 0, num_kerning_pairs), left, right, size); }\n");
+	}
+
+	fprintf(out, "\n} // namespace %s\n", namespace_name_.c_str());
+
+	if (fclose(out) != 0)
+		panic("write failed: %s", strerror(errno));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sheet_writer.h"
+
+// a C++ header with the sprite sheet as constexpr tables, to be compiled
+// into the game: a sprite_id enum, and a lookup from sprite name (or glyph
+// code) to index that can run at compile time. names are looked up with a
+// perfect hash: bucket_seeds picks, for the bucket a name falls in, the
+// seed that sends it to its own slot
+class header_sheet_writer : public sheet_writer
+{
+public:
+	header_sheet_writer(const std::string& path, const std::string& namespace_name);
+
+	void texture(const std::string& path) override;
+	void begin_sprite() override;
+	void end_sprite() override;
+	void kerning(int size, int left, int right, int amount) override;
+	void finish() override;
+
+	void attribute(const char *name, int value) override;
+	void attribute(const char *name, const std::string& value) override;
+
+private:
+	struct entry
+	{
+		std::string name_;
+		bool glyph_, trimmed_;
+		int x_, y_, w_, h_, tex_;
+		bool rotated_;
+		int ox_, oy_, ow_, oh_;
+		int code_, left_, top_, advance_x_, size_;
+	};
+
+	struct kerning_pair
+	{
+		int size_, left_, right_, amount_;
+	};
+
+	std::string path_;
+	std::string namespace_name_;
+	std::vector<std::string> textures_;
+	std::vector<entry> entries_;
+	std::vector<kerning_pair> kerning_;
+};
+
+// the hash used by the generated lookup; seed 0 picks the bucket
+uint32_t
+sprite_header_hash(const char *name, uint32_t seed);
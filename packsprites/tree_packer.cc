@@ -0,0 +1,98 @@
+#include <algorithm>
+
+#include "sprite_base.h"
+#include "tree_packer.h"
+
+tree_packer::tree_packer(int width, int height, bool allow_rotation)
+: nodes_ { node { rect { 0, 0, width, height } } }
+, allow_rotation_ { allow_rotation }
+{ }
+
+bool
+tree_packer::insert(const sprite_base *sp, int border)
+{
+	const int width = sp->width() + 2*border;
+	const int height = sp->height() + 2*border;
+
+	return insert(0, sp, width, height, border, false) ||
+		(allow_rotation_ && width != height && insert(0, sp, height, width, border, true));
+}
+
+std::vector<sprite_rect>
+tree_packer::sprite_rects() const
+{
+	std::vector<sprite_rect> rects;
+	sprite_rects(0, rects);
+	return rects;
+}
+
+bool
+tree_packer::insert(int index, const sprite_base *sp, int width, int height, int border, bool rotated)
+{
+	// doesn't fit anywhere below
+	if (nodes_[index].max_free_width_ < width || nodes_[index].max_free_height_ < height)
+		return false;
+
+	const int children = nodes_[index].children_;
+
+	if (children != -1) {
+		// not a leaf
+		if (!insert(children, sp, width, height, border, rotated) &&
+			!insert(children + 1, sp, width, height, border, rotated))
+			return false;
+	} else {
+		auto& n = nodes_[index];
+
+		// taken, even by a request that is 0x0 like its max free size
+		if (n.sprite_)
+			return false;
+
+		// free leaf large enough
+		if (n.rc_.width_ == width && n.rc_.height_ == height) {
+			n.sprite_ = sp;
+			n.border_ = border;
+			n.rotated_ = rotated;
+			n.max_free_width_ = n.max_free_height_ = 0;
+			return true;
+		}
+
+		std::pair<rect, rect> child_rect;
+
+		if (n.rc_.width_ - width > n.rc_.height_ - height)
+			child_rect = n.rc_.split_vert(width);
+		else
+			child_rect = n.rc_.split_horiz(height);
+
+		// n is invalidated past this point
+
+		const int first = nodes_.size();
+		nodes_.emplace_back(child_rect.first);
+		nodes_.emplace_back(child_rect.second);
+		nodes_[index].children_ = first;
+
+		bool rv = insert(first, sp, width, height, border, rotated);
+		assert(rv);
+	}
+
+	const auto& left = nodes_[nodes_[index].children_];
+	const auto& right = nodes_[nodes_[index].children_ + 1];
+
+	auto& n = nodes_[index];
+	n.max_free_width_ = std::max(left.max_free_width_, right.max_free_width_);
+	n.max_free_height_ = std::max(left.max_free_height_, right.max_free_height_);
+
+	return true;
+}
+
+void
+tree_packer::sprite_rects(int index, std::vector<sprite_rect>& rects) const
+{
+	const auto& n = nodes_[index];
+
+	if (n.children_ != -1) {
+		sprite_rects(n.children_, rects);
+		sprite_rects(n.children_ + 1, rects);
+	} else if (n.sprite_) {
+		rects.push_back({ n.sprite_, rect { n.rc_.left_ + n.border_, n.rc_.top_ + n.border_, n.rc_.width_ - 2*n.border_, n.rc_.height_ - 2*n.border_ }, n.rotated_ });
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "packer.h"
+
+// guillotine packer: recursively splits the free space into a binary tree
+
+class tree_packer : public packer
+{
+public:
+	tree_packer(int width, int height, bool allow_rotation);
+
+	bool insert(const sprite_base *sp, int border) override;
+	std::vector<sprite_rect> sprite_rects() const override;
+
+private:
+	// the nodes live in a single vector and refer to each other by index;
+	// the two children of a node are always next to each other
+	struct node
+	{
+		node(const rect& rc)
+		: rc_(rc), border_(0), sprite_(0), rotated_(false), children_(-1)
+		, max_free_width_(rc.width_), max_free_height_(rc.height_)
+		{ }
+
+		rect rc_;
+		int border_;
+		const sprite_base *sprite_;
+		bool rotated_;
+
+		// index of the first child, or -1 for a leaf
+		int children_;
+
+		// largest width and height of the free leaves below; subtrees
+		// that can't hold a sprite are skipped without walking them
+		int max_free_width_, max_free_height_;
+	};
+
+	bool insert(int index, const sprite_base *sp, int width, int height, int border, bool rotated);
+	void sprite_rects(int index, std::vector<sprite_rect>& rects) const;
+
+	std::vector<node> nodes_;
+	bool allow_rotation_;
+};